@@ -0,0 +1,52 @@
+#include "bench.h"
+
+#include "../src/batch.h"
+#include "../src/pool.h"
+
+#include <vector>
+
+// One operation runs one frame on one machine, all machines start from the same state each call
+namespace {
+
+const size_t MACHINES = 256;
+const unsigned int FRAMES = 10;
+const unsigned int INSTRUCTIONS_PER_SECOND = 6000;
+char const* const ROM = "roms/tetris.ch8";
+
+// Every machine a copy of one, so they stay in lockstep until input differs
+std::vector<Chip8> const& sameSeed(){
+    static std::vector<Chip8> machines(MACHINES, Chip8(ROM));
+    return machines;
+}
+
+// Every machine loaded separately, with its own random seed
+std::vector<Chip8> const& ownSeeds(){
+    static std::vector<Chip8> machines;
+    while (machines.size() < MACHINES)
+        machines.emplace_back(ROM);
+    return machines;
+}
+
+void runBatch(std::vector<Chip8> const& machines){
+    BatchEngine batch(machines, INSTRUCTIONS_PER_SECOND);
+    unsigned long executed = 0;
+    for (unsigned int frame = 0; frame < FRAMES; ++frame)
+        executed += batch.runFrame();
+    doNotOptimize(executed);
+}
+
+// The pool on a single worker, so both run on one core
+void runPool(std::vector<Chip8> const& machines){
+    EmulatorPool pool(1, INSTRUCTIONS_PER_SECOND);
+    for (Chip8 const& machine : machines)
+        pool.add(machine);
+    pool.tick(FRAMES);
+    doNotOptimize(pool.getTotalInstructions());
+}
+
+RegisterBenchmark poolSame("batch/pool same seed", MACHINES * FRAMES, []{ runPool(sameSeed()); });
+RegisterBenchmark batchSame("batch/lockstep same seed", MACHINES * FRAMES, []{ runBatch(sameSeed()); });
+RegisterBenchmark poolOwn("batch/pool own seeds", MACHINES * FRAMES, []{ runPool(ownSeeds()); });
+RegisterBenchmark batchOwn("batch/lockstep own seeds", MACHINES * FRAMES, []{ runBatch(ownSeeds()); });
+
+}
@@ -0,0 +1,86 @@
+#include "bench.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+typedef std::chrono::steady_clock clk;
+
+const double WARMUP_SECONDS = 0.05;
+const double SAMPLE_SECONDS = 0.01; // each sample repeats the body for at least this long
+const unsigned int SAMPLES = 15;
+
+static std::vector<Benchmark>& registry(){
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+}
+
+RegisterBenchmark::RegisterBenchmark(char const* name, unsigned long operations, std::function<void()> body){
+    registry().push_back(Benchmark{ name, operations, body });
+}
+
+char const* writeRom(char const* path, std::vector<uint8_t> const& program){
+    std::ofstream out(path, std::ios::binary);
+    out.write(reinterpret_cast<char const*>(program.data()), program.size());
+    return path;
+}
+
+// Runs the body `repeats` times, returns the elapsed seconds
+static double timeRepeats(Benchmark const& benchmark, unsigned long repeats){
+    clk::time_point start = clk::now();
+    for (unsigned long i = 0; i < repeats; ++i)
+        benchmark.body();
+    return std::chrono::duration<double>(clk::now() - start).count();
+}
+
+static void run(Benchmark const& benchmark){
+    // Warm up caches and branch predictors, and find how many repeats fill a sample
+    unsigned long repeats = 1;
+    double elapsed = 0;
+    clk::time_point warmupStart = clk::now();
+    while (std::chrono::duration<double>(clk::now() - warmupStart).count() < WARMUP_SECONDS || elapsed < SAMPLE_SECONDS){
+        elapsed = timeRepeats(benchmark, repeats);
+        if (elapsed < SAMPLE_SECONDS)
+            repeats *= 2;
+    }
+
+    std::vector<double> nanosPerOp;
+    for (unsigned int i = 0; i < SAMPLES; ++i){
+        double seconds = timeRepeats(benchmark, repeats);
+        nanosPerOp.push_back(seconds * 1e9 / (double(repeats) * benchmark.operations));
+    }
+
+    std::sort(nanosPerOp.begin(), nanosPerOp.end());
+    double mean = 0;
+    for (double sample : nanosPerOp)
+        mean += sample;
+    mean /= nanosPerOp.size();
+    double variance = 0;
+    for (double sample : nanosPerOp)
+        variance += (sample - mean) * (sample - mean);
+    double deviation = std::sqrt(variance / (nanosPerOp.size() - 1));
+    double median = nanosPerOp[nanosPerOp.size() / 2];
+
+    std::printf("%-40s %12.2f %12.2f %10.2f%% %12.2f %16.0f\n", benchmark.name.c_str(),
+                median, mean, 100.0 * deviation / mean, nanosPerOp.front(), 1e9 / median);
+}
+
+// Runs every registered benchmark, or only those whose name contains one of the arguments.
+// --roms runs none, it only leaves the roms the benchmarks wrote while registering in bin/
+int main(int argc, char* argv[]){
+    if (argc == 2 && std::strcmp(argv[1], "--roms") == 0)
+        return 0;
+    std::printf("%-40s %12s %12s %11s %12s %16s\n", "benchmark", "median ns/op", "mean ns/op", "stddev", "min ns/op", "ops/s");
+    for (Benchmark const& benchmark : registry()){
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; ++i)
+            selected = selected || std::strstr(benchmark.name.c_str(), argv[i]) != nullptr;
+        if (selected)
+            run(benchmark);
+    }
+    return 0;
+}
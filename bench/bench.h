@@ -0,0 +1,31 @@
+#ifndef BENCH_HEADER
+#define BENCH_HEADER
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// A micro-benchmark: body performs `operations` operations each time it is called,
+// results are reported per operation
+struct Benchmark {
+    std::string name;
+    unsigned long operations;
+    std::function<void()> body;
+};
+
+// Registers a benchmark during static initialization, declare one per benchmark at file scope
+struct RegisterBenchmark {
+    RegisterBenchmark(char const* name, unsigned long operations, std::function<void()> body);
+};
+
+// Writes program to path as a rom for a benchmark to load, returns path
+char const* writeRom(char const* path, std::vector<uint8_t> const& program);
+
+// Keeps the compiler from optimizing away a value the benchmark computes
+template <class T>
+inline void doNotOptimize(T const& value){
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+#endif
@@ -0,0 +1,91 @@
+#include "bench.h"
+
+#include "../src/chip8.h"
+#include "../src/romstore.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// One operation runs one instruction through Chip8::cycle(), so ops/s is instructions per second.
+// Build with DISPATCH=flat or DISPATCH=predecode to compare the schemes, the name says which ran
+namespace {
+
+const unsigned int CYCLES = 1024; // per call of a body
+
+// A long loop of register arithmetic, index updates and calls, too long to be taken for a polling loop
+char const* aluRom(){
+    static const uint8_t pattern[] = {
+        0x6A, 0x05, // LD VA, 5
+        0x7A, 0x01, // ADD VA, 1
+        0x6B, 0x03, // LD VB, 3
+        0x8A, 0xB4, // ADD VA, VB
+        0x8A, 0xB5, // SUB VA, VB
+        0x8A, 0xB2, // AND VA, VB
+        0xA3, 0x00, // LD I, 0x300
+        0xFA, 0x1E, // ADD I, VA
+    };
+    std::vector<uint8_t> program;
+    for (unsigned int i = 0; i < 128; ++i)
+        program.insert(program.end(), pattern, pattern + sizeof(pattern));
+    program.push_back(0x12); // JP 0x200
+    program.push_back(0x00);
+    return writeRom("bin/alu.ch8", program);
+}
+// Written while the program starts, as the other benchmark roms are
+char const* const ALU_ROM = aluRom();
+
+Chip8& alu(){
+    static Chip8 device(ALU_ROM);
+    return device;
+}
+
+// Without timers ticking tetris ends up polling, the mix of a real rom waiting for its next frame
+Chip8& tetris(){
+    static Chip8 device("roms/tetris.ch8");
+    return device;
+}
+
+void run(Chip8& device){
+    for (unsigned int i = 0; i < CYCLES; ++i)
+        device.cycle();
+    doNotOptimize(device.displayMemory[0]);
+}
+
+std::string dispatchName = std::string("cycle/") + Chip8::dispatchName();
+
+RegisterBenchmark aluCycle((dispatchName + " alu").c_str(), CYCLES, []{ run(alu()); });
+RegisterBenchmark tetrisCycle((dispatchName + " tetris").c_str(), CYCLES, []{ run(tetris()); });
+
+// One operation loads the whole tetris rom into a machine, by path through the rom store or from an image already held
+RegisterBenchmark load("rom/load tetris", 1, []{
+    static Chip8 device;
+    device.LoadROM("roms/tetris.ch8");
+    doNotOptimize(device.displayMemory[0]);
+});
+RegisterBenchmark loadImage("rom/load tetris image", 1, []{
+    static Chip8 device;
+    static std::shared_ptr<RomImage const> rom = RomStore::shared().open("roms/tetris.ch8");
+    device.LoadROM(*rom);
+    doNotOptimize(device.displayMemory[0]);
+});
+// One operation starts a machine from scratch, as a pool or batch does for each instance
+RegisterBenchmark startImage("rom/new machine from image", 1, []{
+    static std::shared_ptr<RomImage const> rom = RomStore::shared().open("roms/tetris.ch8");
+    std::unique_ptr<Chip8> device(new Chip8(*rom));
+    doNotOptimize(device->displayMemory[0]);
+});
+// Or reuses one, as a fuzzer going through many roms would
+RegisterBenchmark resetImage("rom/reset machine from image", 1, []{
+    static Chip8 device;
+    static std::shared_ptr<RomImage const> rom = RomStore::shared().open("roms/tetris.ch8");
+    device.reset();
+    device.LoadROM(*rom);
+    doNotOptimize(device.displayMemory[0]);
+});
+RegisterBenchmark startFile("rom/new machine from path", 1, []{
+    std::unique_ptr<Chip8> device(new Chip8("roms/tetris.ch8"));
+    doNotOptimize(device->displayMemory[0]);
+});
+
+}
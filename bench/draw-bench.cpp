@@ -0,0 +1,69 @@
+#include "bench.h"
+
+#include "../src/chip8.h"
+
+#include <string>
+#include <vector>
+
+// One operation runs one DRW (or CLS) through Chip8::cycle(), sprites are XORed on and off the same spot
+namespace {
+
+const unsigned int CYCLES = 1024; // per call of a body
+const unsigned int REPEATS = 1024; // copies of the instruction in a rom, followed by a jump back to the first
+
+// Sets the position and I then repeats instruction, x and y may be past the screen to wrap around
+std::string repeatRom(std::string const& name, uint8_t x, uint8_t y, uint16_t instruction){
+    std::vector<uint8_t> program = {
+        0x60, x, // LD V0, x
+        0x61, y, // LD V1, y
+        0xA2, 0x00, // LD I, 0x200 (any bytes make a sprite)
+    };
+    for (unsigned int i = 0; i < REPEATS; ++i){
+        program.push_back(instruction >> 8u);
+        program.push_back(instruction & 0xFFu);
+    }
+    program.push_back(0x12); // JP 0x206
+    program.push_back(0x06);
+    std::string path = "bin/" + name + ".ch8";
+    writeRom(path.c_str(), program);
+    return path;
+}
+
+struct Case {
+    Chip8 device;
+
+    Case(std::string const& name, uint8_t x, uint8_t y, uint16_t instruction) : device(repeatRom(name, x, y, instruction).c_str()) {
+        // Past the setup, every cycle after this is the repeated instruction
+        for (unsigned int i = 0; i < 3; ++i)
+            device.cycle();
+    }
+
+    void run(){
+        for (unsigned int i = 0; i < CYCLES; ++i)
+            device.cycle();
+        doNotOptimize(device.displayMemory[0]);
+    }
+};
+
+// DRW V0, V1, height
+uint16_t draw(unsigned int height){
+    return 0xD010u | height;
+}
+
+Case height1("draw1", 3, 8, draw(1));
+Case height5("draw5", 3, 8, draw(5));
+Case height15("draw15", 3, 8, draw(15));
+Case aligned15("draw15-aligned", 8, 8, draw(15)); // starts on a byte boundary
+Case clipped15("draw15-clipped", 60, 24, draw(15)); // runs off the right and bottom edges
+Case wrapped15("draw15-wrapped", 64 + 3, 32 + 8, draw(15)); // starting position wraps around
+Case clear("cls", 0, 0, 0x00E0u);
+
+RegisterBenchmark benchHeight1("draw/height 1", CYCLES, []{ height1.run(); });
+RegisterBenchmark benchHeight5("draw/height 5", CYCLES, []{ height5.run(); });
+RegisterBenchmark benchHeight15("draw/height 15", CYCLES, []{ height15.run(); });
+RegisterBenchmark benchAligned15("draw/height 15 aligned", CYCLES, []{ aligned15.run(); });
+RegisterBenchmark benchClipped15("draw/height 15 clipped", CYCLES, []{ clipped15.run(); });
+RegisterBenchmark benchWrapped15("draw/height 15 wrapped", CYCLES, []{ wrapped15.run(); });
+RegisterBenchmark benchClear("draw/cls", CYCLES, []{ clear.run(); });
+
+}
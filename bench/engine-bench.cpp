@@ -0,0 +1,44 @@
+#include "bench.h"
+
+#include "../src/chip8.h"
+#include "../src/engine.h"
+
+#include <vector>
+
+// One operation uploads display pixels to the software renderer and presents them.
+// Needs SDL, built only with make bench SDL_BENCH=1. Uses SDL's dummy video driver
+// unless SDL_VIDEODRIVER is set, so it runs without a display and measures no vsync
+namespace {
+
+const int SCALE = 10;
+
+Engine& engine(){
+    static bool driver = SDL_setenv("SDL_VIDEODRIVER", "dummy", 0 /*keep one already set*/) == 0;
+    (void)driver;
+    // As main.cpp sets it up with --software: the texture is pre-scaled to the window
+    static Engine engine("CHIP-8 benchmark",
+                         VIDEO_WIDTH * SCALE, VIDEO_HEIGHT * SCALE,
+                         VIDEO_WIDTH * SCALE, VIDEO_HEIGHT * SCALE,
+                         true);
+    return engine;
+}
+
+std::vector<uint32_t>& pixels(){
+    static std::vector<uint32_t> pixels(VIDEO_WIDTH * SCALE * VIDEO_HEIGHT * SCALE, 0xE0D0C0FFu);
+    return pixels;
+}
+
+const int PITCH = sizeof(uint32_t) * VIDEO_WIDTH * SCALE;
+
+RegisterBenchmark full("engine/update software full", 1, []{
+    engine().update(pixels().data(), PITCH);
+});
+// A typical frame of a game that moves one sprite, 5 display rows
+RegisterBenchmark rows("engine/update software 5 rows", 1, []{
+    engine().update(pixels().data(), PITCH, 8 * SCALE, 5 * SCALE);
+});
+RegisterBenchmark present("engine/present software", 1, []{
+    engine().present();
+});
+
+}
@@ -0,0 +1,60 @@
+#include "bench.h"
+
+#include "../src/batch.h"
+#include "../src/scheduler.h"
+
+#include <vector>
+
+// One operation runs one frame on one machine of a rom that does little but draw random numbers
+namespace {
+
+const size_t MACHINES = 256;
+const unsigned int FRAMES = 10;
+const unsigned int INSTRUCTIONS_PER_SECOND = 6000;
+
+// RND V0..V7 with every mask bit set, then jump back to the start
+char const* rom(){
+    return writeRom("bin/rnd.ch8", {
+        0xC0, 0xFF, 0xC1, 0xFF, 0xC2, 0xFF, 0xC3, 0xFF,
+        0xC4, 0xFF, 0xC5, 0xFF, 0xC6, 0xFF, 0xC7, 0xFF,
+        0x12, 0x00
+    });
+}
+// Written while the program starts, so make check finds it without running any benchmark
+char const* const ROM = rom();
+
+std::vector<Chip8> const& machines(RandomGenerator generator){
+    static std::vector<Chip8> standard;
+    static std::vector<Chip8> xorshift;
+    std::vector<Chip8>& result = generator == XORSHIFT_GENERATOR ? xorshift : standard;
+    while (result.size() < MACHINES){
+        result.emplace_back(ROM);
+        result.back().setRandomGenerator(generator);
+        result.back().seedRandom(result.size());
+    }
+    return result;
+}
+
+void runBatch(RandomGenerator generator){
+    BatchEngine batch(machines(generator), INSTRUCTIONS_PER_SECOND);
+    unsigned long executed = 0;
+    for (unsigned int frame = 0; frame < FRAMES; ++frame)
+        executed += batch.runFrame();
+    doNotOptimize(executed);
+}
+
+void runSingle(RandomGenerator generator){
+    Chip8 device = machines(generator)[0];
+    Scheduler scheduler(device, INSTRUCTIONS_PER_SECOND);
+    unsigned long executed = 0;
+    for (unsigned int frame = 0; frame < FRAMES; ++frame)
+        executed += scheduler.runFrame();
+    doNotOptimize(executed);
+}
+
+RegisterBenchmark batchStandard("rnd/batch standard", MACHINES * FRAMES, []{ runBatch(STANDARD_GENERATOR); });
+RegisterBenchmark batchXorshift("rnd/batch xorshift", MACHINES * FRAMES, []{ runBatch(XORSHIFT_GENERATOR); });
+RegisterBenchmark singleStandard("rnd/single standard", FRAMES, []{ runSingle(STANDARD_GENERATOR); });
+RegisterBenchmark singleXorshift("rnd/single xorshift", FRAMES, []{ runSingle(XORSHIFT_GENERATOR); });
+
+}
@@ -0,0 +1,38 @@
+#include "bench.h"
+
+#include "../src/snapshot.h"
+
+#include <sstream>
+
+// One operation takes, restores or serializes one snapshot of a running tetris
+namespace {
+
+struct Machine {
+    Chip8 device;
+    Snapshotter snapshotter;
+    Snapshot snapshot;
+
+    Machine() : device("roms/tetris.ch8"), snapshotter(device), snapshot(snapshotter.take()) {
+    }
+};
+
+Machine& machine(){
+    static Machine machine;
+    return machine;
+}
+
+RegisterBenchmark take("snapshot/take", 1, []{
+    Snapshot snapshot = machine().snapshotter.take();
+    doNotOptimize(snapshot.pc);
+});
+RegisterBenchmark restore("snapshot/restore", 1, []{
+    machine().snapshotter.restore(machine().snapshot);
+    doNotOptimize(machine().device.displayMemory[0]);
+});
+RegisterBenchmark save("snapshot/save", 1, []{
+    std::ostringstream out;
+    Snapshotter::save(machine().snapshot, out);
+    doNotOptimize(out.tellp());
+});
+
+}
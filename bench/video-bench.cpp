@@ -0,0 +1,46 @@
+#include "bench.h"
+
+#include "../src/chip8.h"
+#include "../src/video.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// One operation expands a whole 64x32 display
+namespace {
+
+struct Frame {
+    uint64_t rows[VIDEO_HEIGHT];
+    std::vector<uint32_t> pixels;
+
+    Frame(unsigned int scale) : pixels(VIDEO_WIDTH * VIDEO_HEIGHT * scale * scale) {
+        std::mt19937_64 generator(8);
+        for (uint64_t& row : rows)
+            row = generator();
+    }
+};
+
+Frame native(1);
+Frame scaled(10);
+Palette palette = { 0x102030FF, 0xE0D0C0FF };
+std::string vectorName = std::string("expand/") + expandRowsImplementation();
+
+RegisterBenchmark scalar1("expand/scalar", 1, []{
+    expandRowsScalar(native.rows, VIDEO_HEIGHT, VIDEO_WIDTH, native.pixels.data(), palette);
+    doNotOptimize(native.pixels[0]);
+});
+RegisterBenchmark vector1(vectorName.c_str(), 1, []{
+    expandRows(native.rows, VIDEO_HEIGHT, VIDEO_WIDTH, native.pixels.data(), palette);
+    doNotOptimize(native.pixels[0]);
+});
+RegisterBenchmark scalar10("expand/scalar x10", 1, []{
+    expandRowsScalar(scaled.rows, VIDEO_HEIGHT, VIDEO_WIDTH, scaled.pixels.data(), palette, 10);
+    doNotOptimize(scaled.pixels[0]);
+});
+RegisterBenchmark vector10((vectorName + " x10").c_str(), 1, []{
+    expandRows(scaled.rows, VIDEO_HEIGHT, VIDEO_WIDTH, scaled.pixels.data(), palette, 10);
+    doNotOptimize(scaled.pixels[0]);
+});
+
+}
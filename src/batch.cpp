@@ -0,0 +1,425 @@
+#include "batch.h"
+#include "scheduler.h"
+
+#include <cstring>
+
+// Without an instruction rate a frame runs this many instructions, as Scheduler::runFrame() does
+const unsigned int UNLIMITED_FRAME_INSTRUCTIONS = 256;
+// Distinct instructions executed as vectors per step, lanes left after that run one at a time
+const unsigned int MAX_VECTOR_GROUPS = 8;
+
+namespace {
+
+const size_t GROUP = BatchEngine::LANE_GROUP;
+
+// One group of lanes is copied out of the arrays into locals, worked on, and blended back under the mask.
+// Fixed size locals that can't alias anything let the compiler vectorize each loop over the group
+inline void read(uint8_t (&to)[GROUP], uint8_t const* from){
+    std::memcpy(to, from, sizeof(to));
+}
+
+inline void write(uint8_t* to, uint8_t const (&value)[GROUP], uint8_t const (&mask)[GROUP]){
+    uint8_t current[GROUP];
+    std::memcpy(current, to, sizeof(current));
+    for (size_t i = 0; i < GROUP; ++i)
+        current[i] = (value[i] & mask[i]) | (current[i] & ~mask[i]);
+    std::memcpy(to, current, sizeof(current));
+}
+
+inline void write(uint16_t* to, uint16_t const (&value)[GROUP], uint8_t const (&mask)[GROUP]){
+    uint16_t current[GROUP];
+    std::memcpy(current, to, sizeof(current));
+    for (size_t i = 0; i < GROUP; ++i){
+        uint16_t wide = static_cast<int8_t>(mask[i]); // 0xFF widens to 0xFFFF
+        current[i] = (value[i] & wide) | (current[i] & ~wide);
+    }
+    std::memcpy(to, current, sizeof(current));
+}
+
+}
+
+BatchEngine::VectorOp BatchEngine::classify(Chip8::opcodeTableFnPtr function){
+    if (function == &Chip8::OP_6xkk_LD) return LD_BYTE;
+    if (function == &Chip8::OP_7xkk_ADD) return ADD_BYTE;
+    if (function == &Chip8::OP_8xy0_LD) return LD;
+    if (function == &Chip8::OP_8xy1_OR<false>) return OR;
+    if (function == &Chip8::OP_8xy2_AND<false>) return AND;
+    if (function == &Chip8::OP_8xy3_XOR<false>) return XOR;
+    if (function == &Chip8::OP_8xy4_ADD) return ADD;
+    if (function == &Chip8::OP_8xy5_SUB) return SUB;
+    if (function == &Chip8::OP_8xy6_SHR<false>) return SHR;
+    if (function == &Chip8::OP_8xy7_SUBN) return SUBN;
+    if (function == &Chip8::OP_8xyE_SHL<false>) return SHL;
+    if (function == &Chip8::OP_3xkk_SE) return SE_BYTE;
+    if (function == &Chip8::OP_4xkk_SNE) return SNE_BYTE;
+    if (function == &Chip8::OP_5xy0_SE) return SE;
+    if (function == &Chip8::OP_9xy0_SNE) return SNE;
+    if (function == &Chip8::OP_Ex9E_SKP) return SKP;
+    if (function == &Chip8::OP_ExA1_SKNP) return SKNP;
+    if (function == &Chip8::OP_Fx07_LD) return LD_DT;
+    if (function == &Chip8::OP_Fx15_LD) return SET_DT;
+    if (function == &Chip8::OP_Fx18_LD) return SET_ST;
+    if (function == &Chip8::OP_Annn_LD) return LD_I;
+    if (function == &Chip8::OP_Fx1E_ADD) return ADD_I;
+    if (function == &Chip8::OP_1nnn_JP) return JP;
+    if (function == &Chip8::OP_Cxkk_RND) return RND;
+    return NOT_VECTOR;
+}
+
+template<QuirkProfile Profile>
+std::vector<uint8_t> const& BatchEngine::sharedOperationTable(){
+    // Function local statics are initialized exactly once, even with engines built on several threads,
+    // and only for the profiles that are used
+    static std::vector<uint8_t> const table = []{
+        std::vector<uint8_t> operations(0xFFFF + 1);
+        for (unsigned int opcode = 0; opcode <= 0xFFFF; ++opcode)
+            operations[opcode] = classify(Chip8::lookup(opcode, Profile));
+        return operations;
+    }();
+    return table;
+}
+
+std::vector<uint8_t> const& BatchEngine::operationTable(QuirkProfile profile){
+    switch (profile){
+        case COSMAC_VIP_QUIRKS:
+            return sharedOperationTable<COSMAC_VIP_QUIRKS>();
+        case CHIP48_QUIRKS:
+            return sharedOperationTable<CHIP48_QUIRKS>();
+        case SUPERCHIP_QUIRKS:
+            return sharedOperationTable<SUPERCHIP_QUIRKS>();
+        default:
+            return sharedOperationTable<DEFAULT_QUIRKS>();
+    }
+}
+
+BatchEngine::BatchEngine(std::vector<Chip8> const& machines, unsigned int instructionsPerSecond) : machines(machines) {
+    quirks = machines.empty() ? DEFAULT_QUIRKS : machines[0].getQuirkProfile();
+    lanes = (machines.size() + LANE_GROUP - 1) / LANE_GROUP * LANE_GROUP;
+    if (instructionsPerSecond == Scheduler::UNLIMITED)
+        instructionsPerFrame = UNLIMITED_FRAME_INSTRUCTIONS;
+    else {
+        // Same rounding as Scheduler::setInstructionsPerSecond()
+        instructionsPerFrame = (instructionsPerSecond + Scheduler::FRAME_RATE / 2) / Scheduler::FRAME_RATE;
+        if (instructionsPerFrame == 0)
+            instructionsPerFrame = 1;
+    }
+
+    for (std::vector<uint8_t>& vx : registers)
+        vx.assign(lanes, 0);
+    pc.assign(lanes, 0);
+    index.assign(lanes, 0);
+    opcode.assign(lanes, 0);
+    sp.assign(lanes, 0);
+    delayTimer.assign(lanes, 0);
+    soundTimer.assign(lanes, 0);
+    fetched.assign(lanes, 0);
+    active.assign(lanes, 0);
+    pending.assign(lanes, 0);
+    mask.assign(lanes, 0);
+
+    for (size_t lane = 0; lane < machines.size(); ++lane)
+        load(lane);
+
+    vectorInstructions = 0;
+    scalarInstructions = 0;
+}
+
+size_t BatchEngine::size() const {
+    return machines.size();
+}
+
+Chip8 const& BatchEngine::getLane(size_t lane){
+    store(lane);
+    return machines[lane];
+}
+
+uint8_t* BatchEngine::getKeypad(size_t lane){
+    return machines[lane].keypad;
+}
+
+unsigned long long BatchEngine::getVectorInstructions() const {
+    return vectorInstructions;
+}
+
+unsigned long long BatchEngine::getScalarInstructions() const {
+    return scalarInstructions;
+}
+
+void BatchEngine::store(size_t lane){
+    Chip8& machine = machines[lane];
+    for (unsigned int x = 0; x < 16; ++x)
+        machine.registers[x] = registers[x][lane];
+    machine.pc = pc[lane];
+    machine.index = index[lane];
+    machine.opcode = opcode[lane];
+    machine.sp = sp[lane];
+    machine.delayTimer = delayTimer[lane];
+    machine.soundTimer = soundTimer[lane];
+}
+
+void BatchEngine::load(size_t lane){
+    Chip8 const& machine = machines[lane];
+    for (unsigned int x = 0; x < 16; ++x)
+        registers[x][lane] = machine.registers[x];
+    pc[lane] = machine.pc;
+    index[lane] = machine.index;
+    opcode[lane] = machine.opcode;
+    sp[lane] = machine.sp;
+    delayTimer[lane] = machine.delayTimer;
+    soundTimer[lane] = machine.soundTimer;
+}
+
+unsigned long BatchEngine::runFrame(){
+    size_t count = machines.size();
+    for (size_t lane = 0; lane < count; ++lane){
+        machines[lane].clearIdle();
+        active[lane] = 1;
+    }
+
+    std::vector<uint8_t> const& operations = operationTable(quirks);
+    unsigned long executed = 0;
+    for (unsigned int step = 0; step < instructionsPerFrame; ++step){
+        // Fetch every running lane's next instruction
+        unsigned long running = 0;
+        for (size_t lane = 0; lane < count; ++lane){
+            pending[lane] = active[lane];
+            if (!active[lane])
+                continue;
+            uint8_t const* memory = machines[lane].memory;
+            fetched[lane] = (memory[pc[lane] & 0xFFFu] << 8u) | memory[(pc[lane] + 1) & 0xFFFu];
+            ++running;
+        }
+        if (running == 0)
+            break; // every lane is idle
+        executed += running;
+
+        // Each pass takes the first lane still pending, and either executes its instruction
+        // on every pending lane with the same opcode at once, or on that lane alone
+        size_t first = 0;
+        unsigned int groups = 0;
+        while (true){
+            while (first < count && !pending[first])
+                ++first;
+            if (first == count)
+                break;
+
+            uint16_t leader = fetched[first];
+            VectorOp op = groups < MAX_VECTOR_GROUPS ? static_cast<VectorOp>(operations[leader]) : NOT_VECTOR;
+            if (op == NOT_VECTOR){
+                executeScalar(first);
+                pending[first] = 0;
+                continue;
+            }
+
+            std::fill(mask.begin(), mask.begin() + first, 0);
+            unsigned long members = 0;
+            for (size_t lane = first; lane < count; ++lane){
+                uint8_t member = pending[lane] && fetched[lane] == leader;
+                mask[lane] = -member;
+                pending[lane] &= !member;
+                members += member;
+            }
+            executeVector(op, decode(leader));
+            vectorInstructions += members;
+            ++groups;
+        }
+    }
+
+    // Timers of every lane tick once at the end of the frame
+    for (size_t lane = 0; lane < lanes; ++lane){
+        delayTimer[lane] -= delayTimer[lane] != 0;
+        soundTimer[lane] -= soundTimer[lane] != 0;
+    }
+    return executed;
+}
+
+void BatchEngine::executeScalar(size_t lane){
+    store(lane);
+    machines[lane].cycle();
+    load(lane);
+    if (machines[lane].isIdle())
+        active[lane] = 0;
+    ++scalarInstructions;
+}
+
+void BatchEngine::executeVector(VectorOp op, Instruction const& instruction){
+    uint8_t* vx = registers[instruction.x].data();
+    uint8_t* vy = registers[instruction.y].data();
+    uint8_t* vf = registers[0xF].data();
+    uint8_t kk = instruction.kk;
+
+    for (size_t first = 0; first < lanes; first += GROUP){
+        uint8_t m[GROUP];
+        read(m, &mask[first]);
+        uint64_t any[2];
+        std::memcpy(any, m, sizeof(any));
+        if ((any[0] | any[1]) == 0)
+            continue;
+
+        uint8_t x[GROUP], y[GROUP], flag[GROUP], result[GROUP];
+        uint16_t advance[GROUP];
+        for (size_t i = 0; i < GROUP; ++i)
+            advance[i] = 2;
+        read(x, vx + first);
+        read(y, vy + first);
+
+        // Where an instruction sets VF before writing Vx, the registers are read again after VF is written,
+        // so x or y being F gives the same result as the opcode functions
+        switch (op){
+        case LD_BYTE:
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = kk;
+            write(vx + first, result, m);
+            break;
+        case ADD_BYTE:
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] + kk;
+            write(vx + first, result, m);
+            break;
+        case LD:
+            write(vx + first, y, m);
+            break;
+        case OR:
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] | y[i];
+            write(vx + first, result, m);
+            break;
+        case AND:
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] & y[i];
+            write(vx + first, result, m);
+            break;
+        case XOR:
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] ^ y[i];
+            write(vx + first, result, m);
+            break;
+        case ADD:
+            for (size_t i = 0; i < GROUP; ++i){
+                result[i] = x[i] + y[i];
+                flag[i] = result[i] < x[i]; // carried
+            }
+            write(vf + first, flag, m);
+            write(vx + first, result, m);
+            break;
+        case SUB:
+            for (size_t i = 0; i < GROUP; ++i)
+                flag[i] = x[i] > y[i];
+            write(vf + first, flag, m);
+            read(x, vx + first);
+            read(y, vy + first);
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] - y[i];
+            write(vx + first, result, m);
+            break;
+        case SHR:
+            for (size_t i = 0; i < GROUP; ++i)
+                flag[i] = x[i] & 0x1u;
+            write(vf + first, flag, m);
+            read(x, vx + first);
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] >> 1u;
+            write(vx + first, result, m);
+            break;
+        case SUBN:
+            for (size_t i = 0; i < GROUP; ++i)
+                flag[i] = y[i] > x[i];
+            write(vf + first, flag, m);
+            read(x, vx + first);
+            read(y, vy + first);
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = y[i] - x[i];
+            write(vx + first, result, m);
+            break;
+        case SHL:
+            for (size_t i = 0; i < GROUP; ++i)
+                flag[i] = x[i] >> 7u;
+            write(vf + first, flag, m);
+            read(x, vx + first);
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = x[i] << 1u;
+            write(vx + first, result, m);
+            break;
+        case SE_BYTE:
+            for (size_t i = 0; i < GROUP; ++i)
+                advance[i] += (x[i] == kk) * 2;
+            break;
+        case SNE_BYTE:
+            for (size_t i = 0; i < GROUP; ++i)
+                advance[i] += (x[i] != kk) * 2;
+            break;
+        case SE:
+            for (size_t i = 0; i < GROUP; ++i)
+                advance[i] += (x[i] == y[i]) * 2;
+            break;
+        case SNE:
+            for (size_t i = 0; i < GROUP; ++i)
+                advance[i] += (x[i] != y[i]) * 2;
+            break;
+        case SKP:
+        case SKNP:
+            // Each lane looks at its own keypad
+            for (size_t i = 0; i < GROUP && first + i < machines.size(); ++i){
+                bool pressed = machines[first + i].keypad[x[i] & 0xFu] != 0;
+                advance[i] += (pressed == (op == SKP)) * 2;
+            }
+            break;
+        case LD_DT:
+            read(result, &delayTimer[first]);
+            write(vx + first, result, m);
+            break;
+        case SET_DT:
+            write(&delayTimer[first], x, m);
+            break;
+        case SET_ST:
+            write(&soundTimer[first], x, m);
+            break;
+        case LD_I: {
+            uint16_t address[GROUP];
+            for (size_t i = 0; i < GROUP; ++i)
+                address[i] = instruction.nnn;
+            write(&index[first], address, m);
+            break;
+        }
+        case ADD_I: {
+            uint16_t address[GROUP];
+            for (size_t i = 0; i < GROUP; ++i)
+                address[i] = index[first + i] + x[i];
+            write(&index[first], address, m);
+            break;
+        }
+        case JP:
+            // pc + advance lands on the target
+            for (size_t i = 0; i < GROUP; ++i)
+                advance[i] = instruction.nnn - pc[first + i];
+            // A jump backwards may close a polling loop, see Chip8::OP_1nnn_JP()
+            for (size_t i = 0; i < GROUP; ++i){
+                size_t lane = first + i;
+                if (!m[i] || !Chip8::isShortLoop(pc[lane], instruction.nnn))
+                    continue;
+                store(lane);
+                machines[lane].checkIdleLoop(pc[lane], instruction.nnn);
+                if (machines[lane].isIdle())
+                    active[lane] = 0;
+            }
+            break;
+        case RND:
+            // Each lane draws from its own generator, only lanes in the mask may advance it
+            for (size_t i = 0; i < GROUP; ++i)
+                result[i] = m[i] ? machines[first + i].randomByte() & kk : 0;
+            write(vx + first, result, m);
+            break;
+        case NOT_VECTOR:
+            break;
+        }
+
+        // Every lane in the group moves past the instruction, and past the next one if it skipped
+        uint16_t next[GROUP], code[GROUP];
+        for (size_t i = 0; i < GROUP; ++i){
+            next[i] = pc[first + i] + advance[i];
+            code[i] = instruction.opcode;
+        }
+        write(&pc[first], next, m);
+        write(&opcode[first], code, m);
+    }
+}
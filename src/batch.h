@@ -0,0 +1,77 @@
+#ifndef BATCH_HEADER
+#define BATCH_HEADER
+
+#include <vector>
+
+#include "chip8.h"
+
+// Runs many machines in lockstep, one instruction per machine (lane) per step.
+// Registers, pc, index, sp and timers are kept as structure of arrays, one array per field with an entry per lane,
+// so lanes about to execute the same LD, ADD, 8xy* arithmetic, skip, timer, LD I or ADD I instruction
+// are executed together by loops the compiler turns into SIMD code. Jumps and key skips also run as a group.
+// Any other instruction, and lanes that diverged too far, run one lane at a time on that lane's Chip8,
+// which also keeps memory, the display, keypad, stack and random generator.
+// Each lane ends up exactly where a Scheduler in INTERPRETER mode would leave the same machine.
+// Every machine must have the same quirk profile, instructions whose handler has a quirk in that profile run one lane at a time.
+class BatchEngine {
+public:
+    static const size_t LANE_GROUP = 16; // lanes are processed in groups of one 16 byte vector
+
+    BatchEngine(std::vector<Chip8> const& machines, unsigned int instructionsPerSecond);
+
+    size_t size() const;
+    // Runs one frame on every lane, see Scheduler::runFrame(), returns the instructions executed over all lanes
+    unsigned long runFrame();
+
+    // The lane's machine brought up to date with the arrays
+    Chip8 const& getLane(size_t lane);
+    uint8_t* getKeypad(size_t lane);
+
+    // Instructions executed so far by the vector path and one lane at a time
+    unsigned long long getVectorInstructions() const;
+    unsigned long long getScalarInstructions() const;
+
+private:
+    enum VectorOp {
+        NOT_VECTOR,
+        LD_BYTE, ADD_BYTE, LD, OR, AND, XOR, ADD, SUB, SHR, SUBN, SHL,
+        SE_BYTE, SNE_BYTE, SE, SNE, SKP, SKNP,
+        LD_DT, SET_DT, SET_ST, LD_I, ADD_I, JP, RND
+    };
+    static VectorOp classify(Chip8::opcodeTableFnPtr function);
+    // classify() of every opcode, through the opcode tables of a profile
+    static std::vector<uint8_t> const& operationTable(QuirkProfile profile);
+    template<QuirkProfile Profile> static std::vector<uint8_t> const& sharedOperationTable();
+
+    // Copies one lane from the arrays to its machine, and back
+    void store(size_t lane);
+    void load(size_t lane);
+
+    // Executes instruction on every lane where mask is set
+    void executeVector(VectorOp op, Instruction const& instruction);
+    void executeScalar(size_t lane);
+
+    std::vector<Chip8> machines;
+    size_t lanes; // machines.size() rounded up to a whole LANE_GROUP, the extra lanes never run
+    unsigned int instructionsPerFrame;
+    QuirkProfile quirks; // of every machine
+
+    std::vector<uint8_t> registers[16]; // registers[x][lane] holds Vx of that lane
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> index;
+    std::vector<uint16_t> opcode;
+    std::vector<uint8_t> sp;
+    std::vector<uint8_t> delayTimer;
+    std::vector<uint8_t> soundTimer;
+
+    // Per step scratch
+    std::vector<uint16_t> fetched; // next opcode of each lane
+    std::vector<uint8_t> active; // lane still runs this frame
+    std::vector<uint8_t> pending; // lane hasn't executed its instruction this step
+    std::vector<uint8_t> mask; // 0xFF for lanes in the group being executed
+
+    unsigned long long vectorInstructions;
+    unsigned long long scalarInstructions;
+};
+
+#endif
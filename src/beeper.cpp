@@ -0,0 +1,94 @@
+#include "beeper.h"
+#include "scheduler.h"
+
+// Samples in one 60 Hz frame of emulated time
+const long long SAMPLES_PER_FRAME = Beeper::SAMPLE_RATE / Scheduler::FRAME_RATE;
+// How far an edge may be from where the sample clock puts it before the clock is set again,
+// e.g. after the emulation thread stalled or the two clocks drifted apart
+const long long MAX_LATE_SAMPLES = SAMPLES_PER_FRAME;
+const long long MAX_EARLY_SAMPLES = 2 * SAMPLES_PER_FRAME;
+const int16_t AMPLITUDE = 3000;
+// Phase advance per sample, a full turn of the wave is 2^32
+const uint32_t PHASE_STEP = uint32_t((uint64_t(Beeper::TONE_HZ) << 32u) / Beeper::SAMPLE_RATE);
+
+Beeper::Beeper(unsigned int bufferSamples)
+    : initialized(false), device(0),
+      bufferSamples(bufferSamples == 0 ? 1 : bufferSamples > MAX_BUFFER_SAMPLES ? MAX_BUFFER_SAMPLES : bufferSamples) {
+    position = 0;
+    offset = 0;
+    anchored = false;
+    on = false;
+    phase = 0;
+
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) != 0)
+        return;
+    initialized = true;
+    SDL_AudioSpec wanted{};
+    wanted.freq = SAMPLE_RATE;
+    wanted.format = AUDIO_S16SYS;
+    wanted.channels = 1;
+    wanted.samples = this->bufferSamples;
+    wanted.callback = callback;
+    wanted.userdata = this;
+    SDL_AudioSpec obtained{};
+    // No changes allowed, SDL converts to whatever the device needs
+    device = SDL_OpenAudioDevice(nullptr, 0, &wanted, &obtained, 0);
+    if (device == 0)
+        return;
+    this->bufferSamples = obtained.samples;
+    SDL_PauseAudioDevice(device, 0);
+}
+
+Beeper::~Beeper(){
+    if (device != 0)
+        SDL_CloseAudioDevice(device);
+    if (initialized)
+        SDL_QuitSubSystem(SDL_INIT_AUDIO);
+}
+
+bool Beeper::isOpen() const {
+    return device != 0;
+}
+
+unsigned int Beeper::getBufferSamples() const {
+    return bufferSamples;
+}
+
+void Beeper::setTone(unsigned long long frame, bool on){
+    // A full ring drops the edge, the callback is 64 edges behind by then and long out of step anyway
+    if (device != 0)
+        edges.push(Edge{ frame, on });
+}
+
+void Beeper::callback(void* userdata, Uint8* stream, int length){
+    static_cast<Beeper*>(userdata)->fill(reinterpret_cast<int16_t*>(stream), length / sizeof(int16_t));
+}
+
+void Beeper::fill(int16_t* samples, unsigned int count){
+    for (unsigned int i = 0; i < count; ++i, ++position){
+        // Apply the edges due by this sample
+        long long now = static_cast<long long>(position);
+        for (Edge const* edge = edges.front(); edge != nullptr; edge = edges.front()){
+            long long due = static_cast<long long>(edge->frame) * SAMPLES_PER_FRAME + offset;
+            if (!anchored || due < now - MAX_LATE_SAMPLES || due > now + MAX_EARLY_SAMPLES){
+                // Start the edge now, and the ones after it as far apart as their frames
+                offset = now - static_cast<long long>(edge->frame) * SAMPLES_PER_FRAME;
+                anchored = true;
+                due = now;
+            }
+            if (due > now)
+                break;
+            if (edge->on && !on)
+                phase = 0; // every beep starts the same way
+            on = edge->on;
+            edges.pop();
+        }
+
+        if (!on){
+            samples[i] = 0;
+            continue;
+        }
+        samples[i] = phase < 0x80000000u ? AMPLITUDE : -AMPLITUDE;
+        phase += PHASE_STEP;
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef BEEPER_HEADER
+#define BEEPER_HEADER
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+
+#include "ring.h"
+
+// The CHIP-8 buzzer: a square wave played for as long as the sound timer runs.
+// The emulation thread pushes the frames at which the tone starts and stops into a lock-free ring,
+// and SDL's audio callback places them on its own sample clock, keeping the spacing between them.
+// The callback never locks or allocates, so the latency is what the device buffer adds:
+// about two buffers of bufferSamples, under 11 ms with the default 256 at 48 kHz
+class Beeper {
+public:
+    static const int SAMPLE_RATE = 48000;
+    static const unsigned int DEFAULT_BUFFER_SAMPLES = 256;
+    static const unsigned int MAX_BUFFER_SAMPLES = 32768; // SDL counts samples per buffer in 16 bits
+    static const unsigned int TONE_HZ = 440;
+
+    // Opens the default audio device, silent until the first setTone().
+    // bufferSamples is clamped to 1 to MAX_BUFFER_SAMPLES
+    Beeper(unsigned int bufferSamples = DEFAULT_BUFFER_SAMPLES);
+    ~Beeper();
+
+    // False when no audio device could be opened, setTone() then does nothing
+    bool isOpen() const;
+    // Samples per buffer the device actually uses
+    unsigned int getBufferSamples() const;
+
+    // Emulation thread: the tone turns on or off at the start of frame, frames count at 60 Hz
+    void setTone(unsigned long long frame, bool on);
+
+private:
+    struct Edge {
+        unsigned long long frame;
+        bool on;
+    };
+
+    static void callback(void* userdata, Uint8* stream, int length);
+    // Audio thread: renders count samples
+    void fill(int16_t* samples, unsigned int count);
+
+    bool initialized; // SDL's audio subsystem was started, and has to be quit
+    SDL_AudioDeviceID device;
+    unsigned int bufferSamples;
+    SpscRing<Edge, 64> edges;
+
+    // Only touched by the audio callback
+    unsigned long long position; // samples rendered so far
+    long long offset; // an edge at frame f plays at sample f * SAMPLES_PER_FRAME + offset
+    bool anchored; // offset was set by an edge
+    bool on;
+    uint32_t phase; // of the square wave, a full turn is 2^32
+};
+
+#endif
@@ -1,11 +1,54 @@
 #include "chip8.h"
+#include "romstore.h"
+#if defined(CHIP8_PROFILE)
+#include "profiler.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+const uint8_t fontset[FONTSET_SIZE] =
+{
+    // Draws the following charactors using pixels
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
 
-const unsigned int START_ADDRESS = 0x200;
 const unsigned int FONTSET_START_ADDRESS = 0x50;
+// Longest polling loop, in instructions, that checkIdleLoop() looks at
+const unsigned int MAX_IDLE_LOOP_LENGTH = 8;
+// The minimal standard generator, as std::minstd_rand0
+const uint32_t MINSTD_MULTIPLIER = 16807;
+
+namespace {
+
+// How far Fx55 and Fx65 move the index register, once V0 through Vx were stored or loaded
+constexpr unsigned int indexAdvance(IndexQuirk quirk, uint8_t x){
+    return quirk == INDEX_PLUS_X_PLUS_1 ? x + 1u : quirk == INDEX_PLUS_X ? x : 0u;
+}
+
+}
 
 Chip8::Chip8() {
     // Initialize the program counter
-    pc = START_ADDRESS;
+    pc = ROM_START_ADDRESS;
     
     // Load fonts into memory
     for (unsigned int i = 0; i < FONTSET_SIZE; ++i) {
@@ -14,64 +57,194 @@ Chip8::Chip8() {
     
     // handle instruction which generates a random number into a register
     // normally achieved by, reading the value from a noisy disconnected pin or using a dedicated RNG chip
-    ranomdGenerator = std::default_random_engine(std::chrono::system_clock::now().time_since_epoch().count());
-    randDistribByte = std::uniform_int_distribution<uint8_t>(0, 255U); // between 0 and 255
+    random.generator = STANDARD_GENERATOR;
+    seedRandom(std::chrono::system_clock::now().time_since_epoch().count());
     
-    // prepare array of function pointers for the opcode. 
-    setUpPointerTable();
+    useTables<DefaultQuirks>();
 }
 Chip8::Chip8(const char* romPath) : Chip8(){
     LoadROM(romPath);
 }
+Chip8::Chip8(RomImage const& rom) : Chip8(){
+    LoadROM(rom);
+}
 
-void Chip8::LoadROM(char const* filename){
-    // File will carry stream of binary with instructions
-    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+void Chip8::reset(){
+    memset(registers, 0, sizeof(registers));
+    memset(memory, 0, sizeof(memory));
+    memcpy(memory + FONTSET_START_ADDRESS, fontset, FONTSET_SIZE);
+    index = 0;
+    pc = ROM_START_ADDRESS;
+    memset(stack, 0, sizeof(stack));
+    sp = 0;
+    delayTimer = 0;
+    soundTimer = 0;
+    opcode = 0;
+    memset(displayMemory, 0, sizeof(displayMemory));
+    memset(keypad, 0, sizeof(keypad));
 
-    if (file.is_open()){
-        std::streampos size = file.tellg();
-        char* buffer = new char[size];
+    idle = false;
+    // Everything changed as far as the recompiler, snapshots and the display are concerned
+    markMemoryWritten(0, MEMORY_SIZE);
+    markRowsDirty(0, VIDEO_HEIGHT);
+}
+
+void Chip8::seedRandom(uint64_t seed){
+    // As std::minstd_rand0::seed(), which can't start at 0
+    random.standard = seed % MINSTD_MODULUS;
+    if (random.standard == 0)
+        random.standard = 1;
+
+    // xorshift can't start at 0 either, splitmix64 spreads any seed over the whole state
+    uint64_t mixed = seed + 0x9E3779B97F4A7C15ull;
+    mixed = (mixed ^ (mixed >> 30u)) * 0xBF58476D1CE4E5B9ull;
+    mixed = (mixed ^ (mixed >> 27u)) * 0x94D049BB133111EBull;
+    random.xorshift = mixed ^ (mixed >> 31u);
+    if (random.xorshift == 0)
+        random.xorshift = 1;
+    random.bufferLeft = 0;
+}
 
-        // Return pointer to the beginning and fill the buffer
-        file.seekg(0, std::ios::beg);
-        file.read(buffer, size);
-        file.close();
+void Chip8::setRandomGenerator(RandomGenerator generator){
+    random.generator = generator;
+}
 
-        // NB! Memory from 0x000 to 0x1FF is reserved
-        // Load ROM contents from 0x200
-        for (long i = 0; i < size; ++i){
-            memory[START_ADDRESS + i] = buffer[i];
+RandomGenerator Chip8::getRandomGenerator() const {
+    return random.generator;
+}
+
+void Chip8::setQuirkProfile(QuirkProfile profile){
+    switch (profile){
+        case COSMAC_VIP_QUIRKS:
+            useTables<CosmacVipQuirks>();
+            break;
+        case CHIP48_QUIRKS:
+            useTables<Chip48Quirks>();
+            break;
+        case SUPERCHIP_QUIRKS:
+            useTables<SuperChipQuirks>();
+            break;
+        default:
+            useTables<DefaultQuirks>();
+            break;
+    }
+    // Instructions already decoded or translated went to the old profile's handlers
+    markMemoryWritten(0, MEMORY_SIZE);
+}
+
+QuirkProfile Chip8::getQuirkProfile() const {
+    return quirks;
+}
+
+char const* Chip8::quirkProfileName(QuirkProfile profile){
+    switch (profile){
+        case COSMAC_VIP_QUIRKS:
+            return "vip";
+        case CHIP48_QUIRKS:
+            return "chip48";
+        case SUPERCHIP_QUIRKS:
+            return "schip";
+        default:
+            return "default";
+    }
+}
+
+bool Chip8::findQuirkProfile(char const* name, QuirkProfile* profile){
+    for (unsigned int i = 0; i < QUIRK_PROFILES; ++i){
+        if (std::strcmp(name, quirkProfileName(static_cast<QuirkProfile>(i))) == 0){
+            *profile = static_cast<QuirkProfile>(i);
+            return true;
         }
+    }
+    return false;
+}
+
+template<class Quirks>
+void Chip8::useTables(){
+    quirks = Quirks::profile;
+    mainTable = Tables<Quirks>::table;
+#if defined(CHIP8_FLAT_DISPATCH)
+    flatTable = sharedFlatTable<Quirks>();
+#endif
+#if defined(CHIP8_PREDECODE_DISPATCH)
+    handlerTable = sharedHandlerTable<Quirks>();
+#endif
+}
 
-        // Cleanup
-        delete[] buffer;
+uint8_t Chip8::randomByte(){
+    if (random.generator == XORSHIFT_GENERATOR){
+        if (random.bufferLeft == 0){
+            // xorshift64*, each draw split into bytes lowest first
+            for (unsigned int i = 0; i < RandomState::BUFFER_SIZE; i += 8){
+                random.xorshift ^= random.xorshift >> 12u;
+                random.xorshift ^= random.xorshift << 25u;
+                random.xorshift ^= random.xorshift >> 27u;
+                uint64_t draw = random.xorshift * 0x2545F4914F6CDD1Dull;
+                for (unsigned int byte = 0; byte < 8; ++byte)
+                    random.buffer[i + byte] = draw >> (8u * byte);
+            }
+            random.bufferLeft = RandomState::BUFFER_SIZE;
+        }
+        return random.buffer[RandomState::BUFFER_SIZE - random.bufferLeft--];
     }
-    return;
+
+    // The minimal standard generator, scaled to a byte the way libstdc++'s uniform_int_distribution does,
+    // which is what earlier versions used, but written out so every platform gets the same bytes
+    const uint32_t range = MINSTD_MODULUS - 2; // outputs are 1 to modulus - 1
+    const uint32_t scaling = range / 256u;
+    const uint32_t past = 256u * scaling;
+    uint32_t value;
+    do {
+        random.standard = uint64_t(random.standard) * MINSTD_MULTIPLIER % MINSTD_MODULUS;
+        value = random.standard - 1;
+    } while (value >= past);
+    return value / scaling;
+}
+
+bool Chip8::LoadROM(char const* filename){
+    // Through the store, so the file is checked to fit like every other rom
+    std::shared_ptr<RomImage const> rom = RomStore::shared().open(filename);
+    if (!rom)
+        return false;
+    LoadROM(*rom);
+    return true;
+}
+
+void Chip8::LoadROM(RomImage const& rom){
+    size_t size = std::min<size_t>(rom.size(), MAX_ROM_SIZE);
+    memcpy(memory + ROM_START_ADDRESS, rom.data(), size);
+    // A shorter rom leaves nothing behind of the one loaded before it
+    memset(memory + ROM_START_ADDRESS + size, 0, MAX_ROM_SIZE - size);
+    markMemoryWritten(ROM_START_ADDRESS, MAX_ROM_SIZE);
 }
 
 // Sets the entire video buffer to zeroes
-void Chip8::OP_00E0_CLS(){
+void Chip8::OP_00E0_CLS(Instruction const&){
     memset(displayMemory, 0, sizeof(displayMemory));
+    markRowsDirty(0, VIDEO_HEIGHT);
 }
 
 // Reloads the address of the instruction past the one that called the subroutine (which is at the top of the stack) back into the PC.
-void Chip8::OP_00EE_RET(){
+void Chip8::OP_00EE_RET(Instruction const&){
     --sp;
-    pc = stack[sp];
+    pc = stack[sp & 0xFu]; // a broken program can't reach past the 16 levels
 }
 
 // Sets the program counter to addr
 // No stack interaction required for a jump
-void Chip8::OP_1nnn_JP(){
-    uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_1nnn_JP(Instruction const& instruction){
+    uint16_t address = instruction.nnn;
+    // a jump backwards may close a loop that only polls the timer or keys
+    if (address < pc)
+        checkIdleLoop(pc - 2, address);
     pc = address;
 }
 
 // Calls a subroutine and stores the current PC onto the top of the stack (current PC already holds the next instruction after this CALL)
-void Chip8::OP_2nnn_CALL(){
-    uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_2nnn_CALL(Instruction const& instruction){
+    uint16_t address = instruction.nnn;
 
-    stack[sp] = pc;
+    stack[sp & 0xFu] = pc; // a broken program can't reach past the 16 levels
     ++sp;
     pc = address;
 }
@@ -79,9 +252,9 @@ void Chip8::OP_2nnn_CALL(){
 // Instruction: SE Vx, byte
 // Skips the following instruction on a condition that Vx = kk
 // Note, pc already incremented, so to skip the next instruction, increment pc only once to skip
-void Chip8::OP_3xkk_SE(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // snuff out 8 lower order bits
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_3xkk_SE(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     if (registers[Vx] == byte)
     {
@@ -92,9 +265,9 @@ void Chip8::OP_3xkk_SE(){
 // Instruction: SNE Vx, byte
 // Skips the following instruction on a condition that Vx != kk
 // Note, pc already incremented, so to skip the next instruction, increment pc only once to skip
-void Chip8::OP_4xkk_SNE(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // remove 8 lower order bits
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_4xkk_SNE(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     if (registers[Vx] != byte)
     {
@@ -105,9 +278,9 @@ void Chip8::OP_4xkk_SNE(){
 // Instruction: SE Vx, Vy
 // Skips the following instruction on a condition that Vx = vy
 // Note, pc already incremented, so to skip the next instruction, increment pc only once to skip
-void Chip8::OP_5xy0_SE(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // snuff out 8 lower order bits
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u; // snuff out 4 lower order bits
+void Chip8::OP_5xy0_SE(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     if (registers[Vx] == registers[Vy])
     {
@@ -117,58 +290,68 @@ void Chip8::OP_5xy0_SE(){
 
 // Instruction: LD Vx, byte
 // Sets a register ( Vx)
-void Chip8::OP_6xkk_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // snuff out 8 lower order bits
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_6xkk_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     registers[Vx] = byte;
 }
 
 // Adds
-void Chip8::OP_7xkk_ADD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // remove 8 lower order bits
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_7xkk_ADD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
     registers[Vx] += byte;
 }
 
 // Instruction: LD Vx, Vy
 // Sets a register ( Vx) with contents of another register
-void Chip8::OP_8xy0_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+void Chip8::OP_8xy0_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] = registers[Vy];
 }
 
 // Instruction: OR Vx, Vy
-void Chip8::OP_8xy1_OR(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+// The COSMAC VIP ran the logic instructions through code that left VF cleared (resetsVF)
+template<bool resetsVF>
+void Chip8::OP_8xy1_OR(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] |= registers[Vy];
+    if (resetsVF)
+        registers[0xF] = 0;
 }
 
 // Instruction: AND Vx, Vy
-void Chip8::OP_8xy2_AND(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template<bool resetsVF>
+void Chip8::OP_8xy2_AND(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] &= registers[Vy];
+    if (resetsVF)
+        registers[0xF] = 0;
 }
 
 // Instruction: XOR Vx, Vy
-void Chip8::OP_8xy3_XOR(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+template<bool resetsVF>
+void Chip8::OP_8xy3_XOR(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     registers[Vx] ^= registers[Vy];
+    if (resetsVF)
+        registers[0xF] = 0;
 }
 
 // Adds
-void Chip8::OP_8xy4_ADD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // snuff out 8 lower order bits
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u; // snuff out 4 lower order bits
+void Chip8::OP_8xy4_ADD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     uint16_t sum = registers[Vx] + registers[Vy];
 
@@ -185,9 +368,9 @@ void Chip8::OP_8xy4_ADD(){
 }
 
 // Subtracts
-void Chip8::OP_8xy5_SUB(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // snuff out 8 lower order bits
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u; // snuff out 4 lower order bits
+void Chip8::OP_8xy5_SUB(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     if (registers[Vx] > registers[Vy])
     { // Set NOT borrow bit, VF
@@ -203,9 +386,18 @@ void Chip8::OP_8xy5_SUB(){
 
 // Instruction: SHR Vx
 // Shifts bits to the right by 1
-void Chip8::OP_8xy6_SHR(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u; // snuff out 8 lower order bits
+template<bool readsVy>
+void Chip8::OP_8xy6_SHR(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
     
+    if (readsVy){
+        // The COSMAC VIP stores Vy shifted in Vx, VF is written last so the flag survives x being F
+        uint8_t value = registers[instruction.y];
+        registers[Vx] = value >> 1;
+        registers[0xF] = value & 0x1u;
+        return;
+    }
+
     // If most-significant bit is 1, then VF is set to 1
     registers[0xF] = (registers[Vx] & 0x1u); // Save LSB in VF
 
@@ -214,10 +406,10 @@ void Chip8::OP_8xy6_SHR(){
 
 // subtracts register value from another register value
 // note, SUBN Vx, Vy sets Vx = Vy - Vx
-void Chip8::OP_8xy7_SUBN()
+void Chip8::OP_8xy7_SUBN(Instruction const& instruction)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     if (registers[Vy] > registers[Vx])
     { //  set VF = NOT borrow.
@@ -232,8 +424,17 @@ void Chip8::OP_8xy7_SUBN()
 }
 
 // shifts bits to the left, by 1
-void Chip8::OP_8xyE_SHL(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template<bool readsVy>
+void Chip8::OP_8xyE_SHL(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+
+    if (readsVy){
+        // As OP_8xy6_SHR()
+        uint8_t value = registers[instruction.y];
+        registers[Vx] = value << 1;
+        registers[0xF] = (value & 0x80u) >> 7u;
+        return;
+    }
 
     // Save MSB in VF
     // If most-significant bit is 1, then VF is set to 1
@@ -245,10 +446,10 @@ void Chip8::OP_8xyE_SHL(){
 // Instruction: SNE Vx, Vy
 // Skips the following instruction on a condition that Vx != vy
 // Note, pc already incremented, so to skip the next instruction, increment pc only once to skip
-void Chip8::OP_9xy0_SNE()
+void Chip8::OP_9xy0_SNE(Instruction const& instruction)
 {
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
 
     if (registers[Vx] != registers[Vy])
     {
@@ -258,77 +459,69 @@ void Chip8::OP_9xy0_SNE()
 
 // instruction: LD I, addr
 // Sets a register the index register to a given address ( I)
-void Chip8::OP_Annn_LD(){
-    uint16_t address = opcode & 0x0FFFu;
+void Chip8::OP_Annn_LD(Instruction const& instruction){
+    uint16_t address = instruction.nnn;
 
     index = address;
 }
 
 // instruction: JP V0, addr
 // Jumps to the addr of V0 + nnn.
-void Chip8::OP_Bnnn_JP(){
-    uint16_t address = opcode & 0x0FFFu;
+// CHIP-48 and SUPER-CHIP read it as JP Vx, xnn instead (readsVx)
+template<bool readsVx>
+void Chip8::OP_Bnnn_JP(Instruction const& instruction){
+    uint16_t address = instruction.nnn;
 
-    pc = registers[0] + address;
+    pc = registers[readsVx ? instruction.x : 0] + address;
 }
 
 // instruction: RND Vx, byte
 // Set Vx to: (random byte) AND kk.
-void Chip8::OP_Cxkk_RND(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t byte = opcode & 0x00FFu;
+void Chip8::OP_Cxkk_RND(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t byte = instruction.kk;
 
-    registers[Vx] = randDistribByte(ranomdGenerator) & byte;
+    registers[Vx] = randomByte() & byte;
 }
 
 // instruction: DRW Vx, Vy, nibble
 // Displays n-byte sprite from memory of index register at (Vx, Vy), and sets VF to express a collision.
-void Chip8::OP_Dxyn_DRW(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-    uint8_t Vy = (opcode & 0x00F0u) >> 4u;
-    uint8_t height = opcode & 0x000Fu; // n-bytes
+void Chip8::OP_Dxyn_DRW(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
+    uint8_t Vy = instruction.y;
+    uint8_t height = instruction.n; // n-bytes
 
-    // Wraps around screen beyond boundaries
+    // Wraps the starting position around the screen, the sprite itself is clipped at the edges
     uint8_t xPos = registers[Vx] % VIDEO_WIDTH;
     uint8_t yPos = registers[Vy] % VIDEO_HEIGHT;
+    unsigned int rows = yPos + height < VIDEO_HEIGHT ? height : VIDEO_HEIGHT - yPos;
 
-    // Reset VF in order to use it to express collisions
-    registers[0xF] = 0;
-
-    for (unsigned int row = 0; row < height; ++row)
+    uint64_t collisions = 0;
+    for (unsigned int row = 0; row < rows; ++row)
     {
-        // from memory of index register until n-bytse
-        uint8_t spriteByte = memory[index + row];
+        // from memory of index register until n-bytes
+        uint8_t spriteByte = memory[(index + row) & 0xFFFu];
+        // Line the sprite's eight pixels up with the row, pixels past the right edge are shifted out
+        uint64_t spriteRow = (uint64_t(spriteByte) << 56u) >> xPos;
+        uint64_t* screenRow = &displayMemory[yPos + row];
+
         // There may be a screen pixel collision with what’s already being displayed
-        for (unsigned int col = 0; col < 8; ++col)
-        { // sprites are eight bits wide (represents 8 pixels of screen width)
-            uint8_t spritePixel = spriteByte & (0x80u >> col);
-            // retrieve current pixel
-            uint32_t* screenPixel = &displayMemory[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
-
-            // Sprite pixel is on
-            if (spritePixel)
-            {
-                // Screen pixel is also on
-                if (*screenPixel == 0xFFFFFFFF)
-                {// equals collision
-                    registers[0xF] = 1;
-                }
-
-                // Effectively XOR with the sprite pixel
-                *screenPixel ^= 0xFFFFFFFF;
-            }
-        }
+        collisions |= *screenRow & spriteRow;
+        *screenRow ^= spriteRow;
     }
+
+    // VF expresses whether any pixel was switched off
+    registers[0xF] = collisions != 0;
+    markRowsDirty(yPos, yPos + rows);
 }
 
 // Instruction: SKP Vx
 // Skips the next instruction if the user presses a key with the value of Vx
 // Note, pc already incremented, so to skip the next instruction, increment pc only once to skip
-void Chip8::OP_Ex9E_SKP(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Ex9E_SKP(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
-    uint8_t key = registers[Vx];
+    uint8_t key = registers[Vx] & 0xFu; // only 16 keys
 
     if (keypad[key])
     {
@@ -339,10 +532,10 @@ void Chip8::OP_Ex9E_SKP(){
 // Instruction: SKNP Vx
 // Skips the next instruction if user does not press the key with the value of Vx
 // Note, pc already incremented, so to skip the next instruction, increment pc only once to skip
-void Chip8::OP_ExA1_SKNP(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_ExA1_SKNP(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
-        uint8_t key = registers[Vx];
+        uint8_t key = registers[Vx] & 0xFu; // only 16 keys
 
         if (!keypad[key])
         {
@@ -352,8 +545,8 @@ void Chip8::OP_ExA1_SKNP(){
 
 // Instruction:  LD Vx, DT
 // Sets Vx with a delay timer value
-void Chip8::OP_Fx07_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx07_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     registers[Vx] = delayTimer;
 }
@@ -361,8 +554,8 @@ void Chip8::OP_Fx07_LD(){
 // Instruction: LD Vx, K
 // Waits for a key press, then stores the value in Vx
 // Note, pc is already incremented by here, this function may decrement pc to repeat this instruction
-void Chip8::OP_Fx0A_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx0A_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     if (keypad[0])
         registers[Vx] = 0;
@@ -397,37 +590,40 @@ void Chip8::OP_Fx0A_LD(){
     else if (keypad[15])
         registers[Vx] = 15;
     else
+    {
         pc -= 2; // waits whenever a keypad value is not detected (by running the same instruction repeatedly)
+        idle = true; // nothing more happens until a key changes
+    }
 }
 
 // Instruction: LD DT, Vx
 // Sets the Delay timer to the value in Vx
-void Chip8::OP_Fx15_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx15_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     delayTimer = registers[Vx];
 }
 
 // Instruction: LD ST, Vx
 // Sets the Sound timer to the value in Vx
-void Chip8::OP_Fx18_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx18_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     soundTimer = registers[Vx];
 }
 
 // Instruction: ADD I, Vx
 // Adds the Index register value with the value of Vx
-void Chip8::OP_Fx1E_ADD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx1E_ADD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     index += registers[Vx];
 }
 
 // Instruction: LD F, Vx
 // Set the index register with the address of the sprite representing a digit in Vx.
-void Chip8::OP_Fx29_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx29_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
     uint8_t digit = registers[Vx];
     
     // Font characters are 5 bytes each
@@ -435,128 +631,321 @@ void Chip8::OP_Fx29_LD(){
 }
 // Instruction: LD B, Vx
 // Stores the Binary Coded Decimal (BCD) of Vx in locations I, I+1, and I+2.
-void Chip8::OP_Fx33_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+void Chip8::OP_Fx33_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
     uint8_t value = registers[Vx];
     
     // 8 bit = maximum of 255
     // oneth digit
-    memory[index + 2] = value % 10; // eg, 255 % 10 = 5
+    memory[(index + 2) & 0xFFFu] = value % 10; // eg, 255 % 10 = 5
     value /= 10; // eg 255 / 10 = 25.5
 
     // Tenth digit
-    memory[index + 1] = value % 10; // eg 25 % 10 = 5
+    memory[(index + 1) & 0xFFFu] = value % 10; // eg 25 % 10 = 5
     value /= 10; // eg 25 / 10 = 2.5
 
     // Hundredth digit
-    memory[index] = value % 10; // eg 2 % 10 = 2
+    memory[index & 0xFFFu] = value % 10; // eg 2 % 10 = 2
+
+    markMemoryWritten(index, 3);
 }
 
 // Instruction: LD [I], Vx
 // Stores registers V0 through Vx in memory, starting from location I
-void Chip8::OP_Fx55_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+// The COSMAC VIP and CHIP-48 leave I moved on past them, see IndexQuirk
+template<IndexQuirk indexQuirk>
+void Chip8::OP_Fx55_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     for (uint8_t i = 0; i <= Vx; ++i)
     {
-        memory[index + i] = registers[i];
+        memory[(index + i) & 0xFFFu] = registers[i];
     }
+
+    markMemoryWritten(index, Vx + 1);
+    index += indexAdvance(indexQuirk, Vx);
 }
 
 // Instruction: LD Vx, [I]
 // Loads registers V0 through Vx from memory, starting from location I
-void Chip8::OP_Fx65_LD(){
-    uint8_t Vx = (opcode & 0x0F00u) >> 8u;
+template<IndexQuirk indexQuirk>
+void Chip8::OP_Fx65_LD(Instruction const& instruction){
+    uint8_t Vx = instruction.x;
 
     for (uint8_t i = 0; i <= Vx; ++i)
     {
-        registers[i] = memory[index + i];
+        registers[i] = memory[(index + i) & 0xFFFu];
     }
+
+    index += indexAdvance(indexQuirk, Vx);
 }
 
 // Sets up the Pointer Table
 // This array is used to index the mapped opcode functions using the opcode itself
-void Chip8::setUpPointerTable(){
-    table[0x0] = &Chip8::Table0;
-    table[0x1] = &Chip8::OP_1nnn_JP;
-    table[0x2] = &Chip8::OP_2nnn_CALL;
-    table[0x3] = &Chip8::OP_3xkk_SE;
-    table[0x4] = &Chip8::OP_4xkk_SNE;
-    table[0x5] = &Chip8::OP_5xy0_SE;
-    table[0x6] = &Chip8::OP_6xkk_LD;
-    table[0x7] = &Chip8::OP_7xkk_ADD;
-    table[0x8] = &Chip8::Table8;
-    table[0x9] = &Chip8::OP_9xy0_SNE;
-    table[0xA] = &Chip8::OP_Annn_LD;
-    table[0xB] = &Chip8::OP_Bnnn_JP;
-    table[0xC] = &Chip8::OP_Cxkk_RND;
-    table[0xD] = &Chip8::OP_Dxyn_DRW;
-    table[0xE] = &Chip8::TableE;
-    table[0xF] = &Chip8::TableF;
-
-    table0[0x0] = &Chip8::OP_00E0_CLS;
-    table0[0xE] = &Chip8::OP_00EE_RET;
-
-    table8[0x0] = &Chip8::OP_8xy0_LD;
-    table8[0x1] = &Chip8::OP_8xy1_OR;
-    table8[0x2] = &Chip8::OP_8xy2_AND;
-    table8[0x3] = &Chip8::OP_8xy3_XOR;
-    table8[0x4] = &Chip8::OP_8xy4_ADD;
-    table8[0x5] = &Chip8::OP_8xy5_SUB;
-    table8[0x6] = &Chip8::OP_8xy6_SHR;
-    table8[0x7] = &Chip8::OP_8xy7_SUBN;
-    table8[0xE] = &Chip8::OP_8xyE_SHL;
-
-    tableE[0x1] = &Chip8::OP_ExA1_SKNP;
-    tableE[0xE] = &Chip8::OP_Ex9E_SKP;
-
-    tableF[0x07] = &Chip8::OP_Fx07_LD;
-    tableF[0x0A] = &Chip8::OP_Fx0A_LD;
-    tableF[0x15] = &Chip8::OP_Fx15_LD;
-    tableF[0x18] = &Chip8::OP_Fx18_LD;
-    tableF[0x1E] = &Chip8::OP_Fx1E_ADD;
-    tableF[0x29] = &Chip8::OP_Fx29_LD;
-    tableF[0x33] = &Chip8::OP_Fx33_LD;
-    tableF[0x55] = &Chip8::OP_Fx55_LD;
-    tableF[0x65] = &Chip8::OP_Fx65_LD;
-}
-
-void Chip8::Table0()
+// Entries in the order of the digits that index them
+template<class Quirks>
+const Chip8::opcodeTableFnPtr Chip8::Tables<Quirks>::table[0xF + 1] = {
+    &Chip8::Table0,         &Chip8::OP_1nnn_JP,  &Chip8::OP_2nnn_CALL, &Chip8::OP_3xkk_SE,
+    &Chip8::OP_4xkk_SNE,    &Chip8::OP_5xy0_SE,  &Chip8::OP_6xkk_LD,   &Chip8::OP_7xkk_ADD,
+    &Chip8::Table8<Quirks>, &Chip8::OP_9xy0_SNE, &Chip8::OP_Annn_LD,   &Chip8::OP_Bnnn_JP<Quirks::jumpReadsVx>,
+    &Chip8::OP_Cxkk_RND,    &Chip8::OP_Dxyn_DRW, &Chip8::TableE,       &Chip8::TableF<Quirks>,
+};
+
+// Short names for the tables below only
+#define NOP &Chip8::NULL_OP_DO_NOTHING
+#define OP(name) &Chip8::OP_##name
+
+const Chip8::opcodeTableFnPtr Chip8::table0[0xF + 1] = {
+    OP(00E0_CLS), NOP, NOP, NOP, NOP, NOP, NOP, NOP,
+    NOP,          NOP, NOP, NOP, NOP, NOP, OP(00EE_RET), NOP,
+};
+
+template<class Quirks>
+const Chip8::opcodeTableFnPtr Chip8::Tables<Quirks>::table8[0xF + 1] = {
+    OP(8xy0_LD),  OP(8xy1_OR<Quirks::logicResetsVF>), OP(8xy2_AND<Quirks::logicResetsVF>), OP(8xy3_XOR<Quirks::logicResetsVF>),
+    OP(8xy4_ADD), OP(8xy5_SUB),                       OP(8xy6_SHR<Quirks::shiftReadsVy>),  OP(8xy7_SUBN),
+    NOP,          NOP,                                NOP,                                 NOP,
+    NOP,          NOP,                                OP(8xyE_SHL<Quirks::shiftReadsVy>),  NOP,
+};
+
+const Chip8::opcodeTableFnPtr Chip8::tableE[0xF + 1] = {
+    NOP, OP(ExA1_SKNP), NOP, NOP, NOP, NOP, NOP, NOP,
+    NOP, NOP,           NOP, NOP, NOP, NOP, OP(Ex9E_SKP), NOP,
+};
+
+// One row per high digit of kk
+#define FX55 OP(Fx55_LD<Quirks::loadStoreIndex>)
+#define FX65 OP(Fx65_LD<Quirks::loadStoreIndex>)
+template<class Quirks>
+const Chip8::opcodeTableFnPtr Chip8::Tables<Quirks>::tableF[0xFF + 1] = {
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, OP(Fx07_LD), NOP, NOP, OP(Fx0A_LD), NOP, NOP, NOP, NOP, NOP, // 0x0_
+    NOP, NOP, NOP, NOP, NOP, OP(Fx15_LD), NOP, NOP, OP(Fx18_LD), NOP, NOP, NOP, NOP, NOP, OP(Fx1E_ADD), NOP, // 0x1_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, OP(Fx29_LD), NOP, NOP, NOP, NOP, NOP, NOP, // 0x2_
+    NOP, NOP, NOP, OP(Fx33_LD), NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x3_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x4_
+    NOP, NOP, NOP, NOP, NOP, FX55, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x5_
+    NOP, NOP, NOP, NOP, NOP, FX65, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x6_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x7_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x8_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0x9_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0xA_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0xB_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0xC_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0xD_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0xE_
+    NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, NOP, // 0xF_
+};
+#undef FX55
+#undef FX65
+
+#undef NOP
+#undef OP
+
+// Each profile's handlers are instantiated here, so the other files can name them
+template void Chip8::OP_8xy1_OR<false>(Instruction const&);
+template void Chip8::OP_8xy1_OR<true>(Instruction const&);
+template void Chip8::OP_8xy2_AND<false>(Instruction const&);
+template void Chip8::OP_8xy2_AND<true>(Instruction const&);
+template void Chip8::OP_8xy3_XOR<false>(Instruction const&);
+template void Chip8::OP_8xy3_XOR<true>(Instruction const&);
+template void Chip8::OP_8xy6_SHR<false>(Instruction const&);
+template void Chip8::OP_8xy6_SHR<true>(Instruction const&);
+template void Chip8::OP_8xyE_SHL<false>(Instruction const&);
+template void Chip8::OP_8xyE_SHL<true>(Instruction const&);
+template void Chip8::OP_Bnnn_JP<false>(Instruction const&);
+template void Chip8::OP_Bnnn_JP<true>(Instruction const&);
+template void Chip8::OP_Fx55_LD<INDEX_UNCHANGED>(Instruction const&);
+template void Chip8::OP_Fx55_LD<INDEX_PLUS_X>(Instruction const&);
+template void Chip8::OP_Fx55_LD<INDEX_PLUS_X_PLUS_1>(Instruction const&);
+template void Chip8::OP_Fx65_LD<INDEX_UNCHANGED>(Instruction const&);
+template void Chip8::OP_Fx65_LD<INDEX_PLUS_X>(Instruction const&);
+template void Chip8::OP_Fx65_LD<INDEX_PLUS_X_PLUS_1>(Instruction const&);
+
+void Chip8::Table0(Instruction const& instruction)
 {
-    uint16_t ref = opcode & 0x000Fu;
-    (this->*table0[ref])();
+    uint16_t ref = instruction.n;
+    (this->*table0[ref])(instruction);
 }
 
-void Chip8::Table8()
+template<class Quirks>
+void Chip8::Table8(Instruction const& instruction)
 {
-    uint16_t ref = opcode & 0x000Fu;
-    (this->*table8[ref])();
+    uint16_t ref = instruction.n;
+    (this->*Tables<Quirks>::table8[ref])(instruction);
 }
 
-void Chip8::TableE()
+void Chip8::TableE(Instruction const& instruction)
 {
-    uint16_t ref = opcode & 0x000Fu;
-    (this->*tableE[ref])();
+    uint16_t ref = instruction.n;
+    (this->*tableE[ref])(instruction);
 }
 
-void Chip8::TableF()
+template<class Quirks>
+void Chip8::TableF(Instruction const& instruction)
 {
-    uint16_t ref = opcode & 0x00FFu;
-    (this->*tableF[ref])();
+    uint16_t ref = instruction.kk;
+    (this->*Tables<Quirks>::tableF[ref])(instruction);
 }
 
-void Chip8::NULL_OP_DO_NOTHING(){
+void Chip8::NULL_OP_DO_NOTHING(Instruction const&){
     // Do nothing
 }
 
-void Chip8::cycle(){
+template<class Quirks>
+Chip8::opcodeTableFnPtr Chip8::lookupIn(uint16_t opcode){
+    switch ((opcode & 0xF000u) >> 12u){
+        case 0x0:
+            return table0[opcode & 0x000Fu];
+        case 0x8:
+            return Tables<Quirks>::table8[opcode & 0x000Fu];
+        case 0xE:
+            return tableE[opcode & 0x000Fu];
+        case 0xF:
+            return Tables<Quirks>::tableF[opcode & 0x00FFu];
+        default:
+            return Tables<Quirks>::table[(opcode & 0xF000u) >> 12u];
+    }
+}
+
+Chip8::opcodeTableFnPtr Chip8::lookup(uint16_t opcode, QuirkProfile profile){
+    switch (profile){
+        case COSMAC_VIP_QUIRKS:
+            return lookupIn<CosmacVipQuirks>(opcode);
+        case CHIP48_QUIRKS:
+            return lookupIn<Chip48Quirks>(opcode);
+        case SUPERCHIP_QUIRKS:
+            return lookupIn<SuperChipQuirks>(opcode);
+        default:
+            return lookupIn<DefaultQuirks>(opcode);
+    }
+}
+
+Chip8::opcodeTableFnPtr Chip8::lookup(uint16_t opcode) const {
+    return lookup(opcode, quirks);
+}
+
+void Chip8::markMemoryWritten(uint16_t address, unsigned int length){
+    // Grow the written range, a write that wraps past the end of memory covers all of it
+    unsigned int begin = address & 0xFFFu;
+    unsigned int end = begin + length;
+    if (end > sizeof(memory)){
+        begin = 0;
+        end = sizeof(memory);
+    }
+    if (writtenBegin >= writtenEnd || begin < writtenBegin)
+        writtenBegin = begin;
+    if (end > writtenEnd)
+        writtenEnd = end;
+
+    for (unsigned int page = begin / MEMORY_PAGE_SIZE; page <= (end - 1) / MEMORY_PAGE_SIZE; ++page)
+        pagesWritten |= 1u << page;
+
+#if defined(CHIP8_PREDECODE_DISPATCH)
+    // An instruction starting one byte before the write also read a changed byte
+    for (unsigned int i = 0; i <= length; ++i)
+        decodeCache[(address - 1 + i) & 0xFFFu].handler = 0;
+#endif
+}
+
+#if defined(CHIP8_FLAT_DISPATCH)
+template<class Quirks>
+Chip8::FlatEntry const* Chip8::sharedFlatTable(){
+    // Function local statics are initialized exactly once, even with several threads,
+    // and only for the profiles that are used
+    static std::vector<FlatEntry> flat = []{
+        std::vector<FlatEntry> entries(0xFFFF + 1);
+        for (unsigned int opcode = 0; opcode <= 0xFFFF; ++opcode){
+            entries[opcode].function = lookupIn<Quirks>(opcode);
+            entries[opcode].instruction = decode(opcode);
+        }
+        return entries;
+    }();
+    return flat.data();
+}
+
+char const* Chip8::dispatchName(){
+    return "flat";
+}
+#elif defined(CHIP8_PREDECODE_DISPATCH)
+template<class Quirks>
+Chip8::HandlerTable const* Chip8::sharedHandlerTable(){
+    // Initialized once, as sharedFlatTable() is
+    static HandlerTable const handlers = []{
+        HandlerTable table;
+        table.functions.push_back(nullptr);
+        table.numbers.resize(0xFFFF + 1);
+        for (unsigned int opcode = 0; opcode <= 0xFFFF; ++opcode){
+            opcodeTableFnPtr function = lookupIn<Quirks>(opcode);
+            auto found = std::find(table.functions.begin(), table.functions.end(), function);
+            if (found == table.functions.end())
+                found = table.functions.insert(found, function);
+            // There are a few dozen handlers, far from the 255 a byte can number
+            table.numbers[opcode] = found - table.functions.begin();
+        }
+        return table;
+    }();
+    return &handlers;
+}
+
+char const* Chip8::dispatchName(){
+    return "predecode";
+}
+#else
+char const* Chip8::dispatchName(){
+    return "nested";
+}
+#endif
+
+inline void Chip8::execute(){
+#if defined(CHIP8_PREDECODE_DISPATCH)
+    // Decode each address only the first time it runs, or after it was written to
+    DecodedEntry& entry = decodeCache[pc & 0xFFFu];
+    if (entry.handler == 0){
+        entry.opcode = (memory[pc & 0xFFFu] << 8u) | memory[(pc + 1) & 0xFFFu];
+        entry.handler = handlerTable->numbers[entry.opcode];
+    }
+    opcode = entry.opcode;
+    pc += 2;
+    (this->*handlerTable->functions[entry.handler])(decode(entry.opcode));
+    return;
+#endif
     // Fetch instruction using pc counter and then increment program counter
-    opcode = (memory[pc] << 8u) | memory[pc + 1];
+    opcode = (memory[pc & 0xFFFu] << 8u) | memory[(pc + 1) & 0xFFFu];
     pc += 2;
+#if defined(CHIP8_FLAT_DISPATCH)
+    // Execute opcode straight from its entry in the flat table
+    FlatEntry const& entry = flatTable[opcode];
+    (this->*entry.function)(entry.instruction);
+#else
     // Execute opcode using appropriate function from the opcode table pointer
+    Instruction instruction = decode(opcode);
     uint16_t LeftMostDigit = (opcode & 0xF000u) >> 12u;
-    (this->*table[LeftMostDigit])();
-    
+    (this->*mainTable[LeftMostDigit])(instruction);
+#endif
+}
+
+void Chip8::cycle(){
+#if defined(CHIP8_PROFILE)
+    if (profiler != nullptr){
+        uint16_t next = (memory[pc & 0xFFFu] << 8u) | memory[(pc + 1) & 0xFFFu];
+        if (profiler->count(pc, next)){
+            Profiler::clk::time_point start = Profiler::clk::now();
+            execute();
+            profiler->addSample(next, start, Profiler::clk::now());
+            return;
+        }
+    }
+#endif
+    execute();
+}
+
+#if defined(CHIP8_PROFILE)
+void Chip8::setProfiler(Profiler* profiler){
+    this->profiler = profiler;
+}
+#endif
+
+void Chip8::tickTimers(){
     if (delayTimer > 0)
         // Decrement if it's been set
         --delayTimer;
@@ -565,3 +954,127 @@ void Chip8::cycle(){
         // Decrement if it's been set
         --soundTimer;
 }
+
+bool Chip8::matches(Chip8 const& other) const {
+    return memcmp(registers, other.registers, sizeof(registers)) == 0
+        && memcmp(memory, other.memory, sizeof(memory)) == 0
+        && index == other.index
+        && pc == other.pc
+        && memcmp(stack, other.stack, sizeof(stack)) == 0
+        && sp == other.sp
+        && delayTimer == other.delayTimer
+        && soundTimer == other.soundTimer
+        && memcmp(displayMemory, other.displayMemory, sizeof(displayMemory)) == 0
+        && memcmp(keypad, other.keypad, sizeof(keypad)) == 0;
+}
+
+bool Chip8::isIdle() const {
+    return idle;
+}
+
+void Chip8::clearIdle(){
+    idle = false;
+}
+
+bool Chip8::areTimersRunning() const {
+    return delayTimer > 0 || soundTimer > 0;
+}
+
+bool Chip8::isSoundOn() const {
+    return soundTimer > 0;
+}
+
+bool Chip8::isShortLoop(uint16_t jumpAddress, uint16_t target){
+    return target <= jumpAddress && static_cast<unsigned int>(jumpAddress - target) <= 2 * MAX_IDLE_LOOP_LENGTH;
+}
+
+void Chip8::checkIdleLoop(uint16_t jumpAddress, uint16_t target){
+    if (!isShortLoop(jumpAddress, target))
+        return;
+
+    // Run one iteration of the loop on a copy of the registers, only instructions
+    // that read the delay timer or keys and skip on the result are allowed
+    uint8_t copy[16];
+    memcpy(copy, registers, sizeof(registers));
+    unsigned int address = target;
+    while (address < jumpAddress){
+        Instruction instruction = decode((memory[address & 0xFFFu] << 8u) | memory[(address + 1) & 0xFFFu]);
+        opcodeTableFnPtr function = lookup(instruction.opcode);
+        bool skip = false;
+        if (function == &Chip8::OP_Fx07_LD)
+            copy[instruction.x] = delayTimer;
+        else if (function == &Chip8::OP_3xkk_SE)
+            skip = copy[instruction.x] == instruction.kk;
+        else if (function == &Chip8::OP_4xkk_SNE)
+            skip = copy[instruction.x] != instruction.kk;
+        else if (function == &Chip8::OP_5xy0_SE)
+            skip = copy[instruction.x] == copy[instruction.y];
+        else if (function == &Chip8::OP_9xy0_SNE)
+            skip = copy[instruction.x] != copy[instruction.y];
+        else if (function == &Chip8::OP_Ex9E_SKP)
+            skip = keypad[copy[instruction.x] & 0xFu] != 0;
+        else if (function == &Chip8::OP_ExA1_SKNP)
+            skip = keypad[copy[instruction.x] & 0xFu] == 0;
+        else
+            return; // does real work
+        address += skip ? 4 : 2;
+    }
+
+    // Came back around to the jump with the same registers: until a timer ticks or a key changes,
+    // every iteration is identical. Skipped over the jump: the loop exits by itself
+    if (address == jumpAddress && memcmp(copy, registers, sizeof(registers)) == 0)
+        idle = true;
+}
+
+bool Chip8::isDisplayDirty() const {
+    return dirtyRowBegin < dirtyRowEnd;
+}
+
+unsigned int Chip8::getDirtyRowBegin() const {
+    return dirtyRowBegin;
+}
+
+unsigned int Chip8::getDirtyRowEnd() const {
+    return dirtyRowEnd;
+}
+
+void Chip8::clearDisplayDirty(){
+    dirtyRowBegin = 0;
+    dirtyRowEnd = 0;
+}
+
+void Chip8::markRowsDirty(unsigned int begin, unsigned int end){
+    if (begin >= end)
+        return;
+    if (!isDisplayDirty()){
+        dirtyRowBegin = begin;
+        dirtyRowEnd = end;
+        return;
+    }
+    // Grow the range to cover both
+    if (begin < dirtyRowBegin)
+        dirtyRowBegin = begin;
+    if (end > dirtyRowEnd)
+        dirtyRowEnd = end;
+}
+
+bool Chip8::isHalted() const {
+    // Both cases leave pc pointing back at the instruction that was just executed
+    uint16_t next = (memory[pc & 0xFFFu] << 8u) | memory[(pc + 1) & 0xFFFu];
+    if (next != opcode)
+        return false;
+
+    // JP addr, where addr holds this same jump
+    if ((opcode & 0xF000u) == 0x1000u)
+        return true;
+
+    // LD Vx, K rewinds pc onto itself until a key is pressed
+    if ((opcode & 0xF0FFu) == 0xF00Au){
+        for (unsigned int key = 0; key < 16; ++key){
+            if (keypad[key])
+                return false;
+        }
+        return true;
+    }
+    return false;
+}
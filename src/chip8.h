@@ -4,17 +4,116 @@
 #include <cstdint>
 #include <fstream>
 #include <chrono>
-#include <random>
+#include <vector>
 
 #include "chip8-Constants.h"
 
 const unsigned int VIDEO_HEIGHT = 32;
 const unsigned int VIDEO_WIDTH = 64;
+// Memory writes are tracked in pages of this many bytes, so snapshots only copy pages that changed
+const unsigned int MEMORY_PAGE_SIZE = 256;
+const unsigned int MEMORY_SIZE = 4096;
+const unsigned int MEMORY_PAGES = MEMORY_SIZE / MEMORY_PAGE_SIZE;
+// Roms are loaded from here to the end of memory, what comes before is reserved
+const unsigned int ROM_START_ADDRESS = 0x200;
+const unsigned int MAX_ROM_SIZE = MEMORY_SIZE - ROM_START_ADDRESS;
+
+// An opcode with its operand fields already extracted, handed to each opcode function
+struct Instruction {
+    uint16_t opcode;
+    uint16_t nnn; // lowest 12 bits, an address
+    uint8_t  x; // lower 4 bits of the high byte, a register
+    uint8_t  y; // upper 4 bits of the low byte, a register
+    uint8_t  kk; // lowest 8 bits, a byte
+    uint8_t  n; // lowest 4 bits, a nibble
+};
+
+inline Instruction decode(uint16_t opcode){
+    Instruction instruction;
+    instruction.opcode = opcode;
+    instruction.nnn = opcode & 0x0FFFu;
+    instruction.x = (opcode & 0x0F00u) >> 8u;
+    instruction.y = (opcode & 0x00F0u) >> 4u;
+    instruction.kk = opcode & 0x00FFu;
+    instruction.n = opcode & 0x000Fu;
+    return instruction;
+}
+
+// Where RND gets its random bytes from. Both give the same bytes for the same seed on every platform
+enum RandomGenerator {
+    STANDARD_GENERATOR, // the minimal standard generator (std::minstd_rand0), one draw per byte
+    XORSHIFT_GENERATOR // xorshift64*, a draw fills eight bytes of a buffer that is refilled in bulk
+};
+
+// The minimal standard generator's modulus, its state is always between 1 and this - 1
+const uint32_t MINSTD_MODULUS = 2147483647;
+
+// Everything behind RND, small and trivially copyable so snapshots can keep it as is
+struct RandomState {
+    static const unsigned int BUFFER_SIZE = 32;
+
+    RandomGenerator generator;
+    uint32_t standard; // minimal standard generator, its last output
+    uint64_t xorshift;
+    uint8_t  buffer[BUFFER_SIZE]; // xorshift bytes not yet handed out, the last bufferLeft of them
+    uint8_t  bufferLeft;
+};
+
+// CHIP-8 variants disagree on a few instructions, a profile picks which of them the interpreter follows
+enum QuirkProfile {
+    DEFAULT_QUIRKS, // this emulator's own mix, how earlier versions ran every rom
+    COSMAC_VIP_QUIRKS, // the original interpreter
+    CHIP48_QUIRKS, // CHIP-48 on the HP-48 calculators
+    SUPERCHIP_QUIRKS, // SUPER-CHIP 1.1
+    QUIRK_PROFILES // number of profiles
+};
+
+// Where Fx55 and Fx65 leave the index register
+enum IndexQuirk {
+    INDEX_UNCHANGED,
+    INDEX_PLUS_X, // I += x
+    INDEX_PLUS_X_PLUS_1 // I += x + 1, just past the last register
+};
+
+// Each profile as a policy. The opcode tables of a profile are built from its policy at compile time,
+// so every handler is specialized for the one behaviour it has and checks nothing while running.
+// All of them clip sprites at the edges of the screen, and wrap only the starting position
+struct DefaultQuirks {
+    static const QuirkProfile profile = DEFAULT_QUIRKS;
+    static const bool logicResetsVF = false; // 8xy1, 8xy2 and 8xy3 clear VF
+    static const bool shiftReadsVy = false; // 8xy6 and 8xyE shift Vy into Vx, rather than Vx in place
+    static const IndexQuirk loadStoreIndex = INDEX_UNCHANGED; // Fx55 and Fx65
+    static const bool jumpReadsVx = false; // Bxnn jumps to xnn + Vx, rather than nnn + V0
+};
+struct CosmacVipQuirks {
+    static const QuirkProfile profile = COSMAC_VIP_QUIRKS;
+    static const bool logicResetsVF = true;
+    static const bool shiftReadsVy = true;
+    static const IndexQuirk loadStoreIndex = INDEX_PLUS_X_PLUS_1;
+    static const bool jumpReadsVx = false;
+};
+struct Chip48Quirks {
+    static const QuirkProfile profile = CHIP48_QUIRKS;
+    static const bool logicResetsVF = false;
+    static const bool shiftReadsVy = false;
+    static const IndexQuirk loadStoreIndex = INDEX_PLUS_X;
+    static const bool jumpReadsVx = true;
+};
+struct SuperChipQuirks {
+    static const QuirkProfile profile = SUPERCHIP_QUIRKS;
+    static const bool logicResetsVF = false;
+    static const bool shiftReadsVy = false;
+    static const IndexQuirk loadStoreIndex = INDEX_UNCHANGED;
+    static const bool jumpReadsVx = true;
+};
+
+class Profiler;
+class RomImage;
 
 class Chip8 {
     // REFERENCE at: http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
     uint8_t  registers[16]{}; // 16 registers
-    uint8_t  memory[4096]{}; // 4K byte of memory
+    uint8_t  memory[MEMORY_SIZE]{}; // 4K byte of memory
     uint16_t index{}; // 16 bit index register
     uint16_t pc{}; // 16 bit program counter
     uint16_t stack[16]{}; // 16 level stack
@@ -22,20 +121,98 @@ class Chip8 {
     uint8_t  delayTimer{}; // 8 bit delay timer
     uint8_t  soundTimer{}; // 8 bit sound timer
     
-    uint16_t opcode; // for holding any of the 34 instructions
+    uint16_t opcode{}; // for holding any of the 34 instructions
+    
+    bool idle{}; // see isIdle()
+    unsigned int writtenBegin{}; // memory [begin, end) written since the recompiler last looked
+    unsigned int writtenEnd{};
+    uint16_t pagesWritten{}; // bit p set when memory page p was written since the last snapshot
+    unsigned int dirtyRowBegin{}; // rows [begin, end) of displayMemory changed since clearDisplayDirty()
+    unsigned int dirtyRowEnd{VIDEO_HEIGHT}; // starts fully dirty so the first frame is drawn
     
 
-    std::default_random_engine ranomdGenerator;
-    std::uniform_int_distribution<uint8_t> randDistribByte;
+    RandomState random{};
+    QuirkProfile quirks{DEFAULT_QUIRKS}; // see setQuirkProfile()
+#if defined(CHIP8_PROFILE)
+    Profiler* profiler{}; // see setProfiler()
+#endif
+    
+    // Translates blocks of instructions and runs them against this state
+    friend class Recompiler;
+    // Keeps registers of many machines side by side and runs them in lockstep
+    friend class BatchEngine;
+    // Captures and restores the whole machine state
+    friend class Snapshotter;
+    // Names the handlers behind the opcodes it counted
+    friend class Profiler;
 public:
     Chip8(); // Constructor
     Chip8(const char* romPath);
+    Chip8(RomImage const& rom);
+    
+    // Back to the state at power on: memory holds only the font, the display, registers, stack,
+    // timers and keys are cleared and pc is at the start of the rom. Much cheaper than a new machine.
+    // The quirk profile is kept, and the random generator carries on where it was, seedRandom() restarts it
+    void reset();
     
-    void LoadROM(char const* filename);
+    // Loads the rom file through RomStore::shared(). False, leaving memory as it was,
+    // when the file can't be read or doesn't fit
+    bool LoadROM(char const* filename);
+    // Copies an image already checked to fit, the way to start many machines from one file.
+    // Memory past the end of the rom is cleared, so nothing of a longer rom loaded before is left
+    void LoadROM(RomImage const& rom);
+    // Replaces the clock based seed, so runs with the same seed and input are identical
+    void seedRandom(uint64_t seed);
+    // Chooses the generator behind RND, the standard one by default
+    void setRandomGenerator(RandomGenerator generator);
+    RandomGenerator getRandomGenerator() const;
+    // Chooses which variant the interpreter follows, DEFAULT_QUIRKS unless set.
+    // Meant to be picked with the rom, before it runs. Snapshots don't record it
+    void setQuirkProfile(QuirkProfile profile);
+    QuirkProfile getQuirkProfile() const;
+    // The name of a profile on the command line: default, vip, chip48 or schip
+    static char const* quirkProfileName(QuirkProfile profile);
+    // Finds the profile called name, false when there is none
+    static bool findQuirkProfile(char const* name, QuirkProfile* profile);
     // Emulates the Fetch, Decode, Execute clock cycle of the Chip8 CPU
     void cycle();
+#if defined(CHIP8_PROFILE)
+    // Every instruction cycle() runs is counted by profiler from now on, nullptr stops counting.
+    // Copies of the machine share it
+    void setProfiler(Profiler* profiler);
+#endif
+    // Decrements the delay and sound timers, must be called at 60 Hz of emulated time
+    void tickTimers();
+    // True when the last instruction left the CPU unable to progress on its own
+    // (a jump to itself, or waiting for a key while none are pressed)
+    bool isHalted() const;
+    // True once the program can't do anything new until a timer ticks or a key changes:
+    // it waits for a key, or spins in a short loop that only polls the delay timer or keys.
+    // The rest of the frame can be skipped
+    bool isIdle() const;
+    // Called at the start of each frame, when the timers or keys may have changed
+    void clearIdle();
+    // True while either timer is counting down
+    bool areTimersRunning() const;
+    // True while the sound timer is counting down, when the buzzer sounds
+    bool isSoundOn() const;
+    
+    // Tracks which rows of displayMemory changed since the frontend last drew them,
+    // so an unchanged screen needs no upload or present at all
+    bool isDisplayDirty() const;
+    unsigned int getDirtyRowBegin() const; // first changed row
+    unsigned int getDirtyRowEnd() const; // one past the last changed row
+    void clearDisplayDirty();
     
-    uint32_t displayMemory[64 * 32]{}; // 64x32 Monochrome Display Memory
+    // True when both machines are in exactly the same state, used to check alternative execution engines
+    bool matches(Chip8 const& other) const;
+    
+    // Which dispatch scheme this build uses, "nested", "flat" or "predecode"
+    static char const* dispatchName();
+    
+    // 64x32 Monochrome Display Memory, one word per row
+    // the leftmost pixel of a row is its most significant bit
+    uint64_t displayMemory[VIDEO_HEIGHT]{};
     uint8_t  keypad[16]{}; // 16 input keys
     /*
      Keypad       Keyboard
@@ -50,96 +227,151 @@ public:
      +-+-+-+-+    +-+-+-+-+
      */
 private:
+    // Marks rows [begin, end) of the display as changed
+    void markRowsDirty(unsigned int begin, unsigned int end);
+    // Called after an instruction or ROM load wrote length bytes of memory from address
+    void markMemoryWritten(uint16_t address, unsigned int length);
+    // Called when the jump at jumpAddress goes back to target, sets idle if the loop only polls
+    void checkIdleLoop(uint16_t jumpAddress, uint16_t target);
+    // True when the jump at jumpAddress back to target is short enough for checkIdleLoop() to look at
+    static bool isShortLoop(uint16_t jumpAddress, uint16_t target);
+    // Next byte from the chosen generator
+    uint8_t randomByte();
+    // Points dispatch at the tables of a profile
+    template<class Quirks> void useTables();
+    // Fetches, decodes and executes one instruction, the whole of cycle() unless profiling
+    void execute();
+
 // Functions to map to opcode
     // Clear the display
-    void OP_00E0_CLS();
+    void OP_00E0_CLS(Instruction const& instruction);
     // Returns from a subroutine
-    void OP_00EE_RET();
+    void OP_00EE_RET(Instruction const& instruction);
     // Jumps to an address location
-    void OP_1nnn_JP(); // note, instruction looks like: JP addr
+    void OP_1nnn_JP(Instruction const& instruction); // note, instruction looks like: JP addr
     // Calls a subroutine at loacation
-    void OP_2nnn_CALL();
+    void OP_2nnn_CALL(Instruction const& instruction);
     // Skips next instruction if Vx = kk. note, instruction looks like: SE Vx, byte
-    void OP_3xkk_SE();
+    void OP_3xkk_SE(Instruction const& instruction);
     // Skips next instruction if Vx != kk. note, instruction looks like: SNE Vx, byte
-    void OP_4xkk_SNE();
+    void OP_4xkk_SNE(Instruction const& instruction);
     // Skips next instruction if Vx = Vy. note, instruction looks like: SE Vx, Vy
-    void OP_5xy0_SE();
+    void OP_5xy0_SE(Instruction const& instruction);
     // Sets Vx.
-    void OP_6xkk_LD(); // note, instruction looks like LD Vx, byte
-    void OP_8xy0_LD(); // note, instruction looks like LD Vx, Vy
+    void OP_6xkk_LD(Instruction const& instruction); // note, instruction looks like LD Vx, byte
+    void OP_8xy0_LD(Instruction const& instruction); // note, instruction looks like LD Vx, Vy
     // Adds a value to register's value
-    void OP_7xkk_ADD(); // note, instruction looks like ADD Vx, byte
-    void OP_8xy4_ADD(); // note, instruction looks like ADD Vx, Vy
+    void OP_7xkk_ADD(Instruction const& instruction); // note, instruction looks like ADD Vx, byte
+    void OP_8xy4_ADD(Instruction const& instruction); // note, instruction looks like ADD Vx, Vy
     // Sets Vx with result of OR operation: OR Vx, Vy
-    void OP_8xy1_OR();
+    template<bool resetsVF> void OP_8xy1_OR(Instruction const& instruction);
     // Sets Vx with result of AND operation: AND Vx, Vy
-    void OP_8xy2_AND();
+    template<bool resetsVF> void OP_8xy2_AND(Instruction const& instruction);
     // Sets Vx with result of XOR operation: XOR Vx, Vy
-    void OP_8xy3_XOR();
+    template<bool resetsVF> void OP_8xy3_XOR(Instruction const& instruction);
     // Subtracts a value from a register's value
-    void OP_8xy5_SUB(); // note, instruction looks like SUB Vx, Vy
+    void OP_8xy5_SUB(Instruction const& instruction); // note, instruction looks like SUB Vx, Vy
     // shift bits to the right, by 1
-    void OP_8xy6_SHR();
+    template<bool readsVy> void OP_8xy6_SHR(Instruction const& instruction);
     // subtracts register value from another register value
-    void OP_8xy7_SUBN(); // note, instruction looks like: SUBN Vx, Vy; sets Vx = Vy - Vx
+    void OP_8xy7_SUBN(Instruction const& instruction); // note, instruction looks like: SUBN Vx, Vy; sets Vx = Vy - Vx
     // shifts bits to the left, by 1
-    void OP_8xyE_SHL();
+    template<bool readsVy> void OP_8xyE_SHL(Instruction const& instruction);
     // Skips next instruction if Vx != Vy
-    void OP_9xy0_SNE(); // note, instruction looks like: SNE Vx, Vy
+    void OP_9xy0_SNE(Instruction const& instruction); // note, instruction looks like: SNE Vx, Vy
     // Sets the index register to a given value
-    void OP_Annn_LD(); // note, instruction looks like: LD I, addr
-    // Jumps to the addr of V0 + nnn.
-    void OP_Bnnn_JP(); // note, instruction looks like: JP V0, addr
+    void OP_Annn_LD(Instruction const& instruction); // note, instruction looks like: LD I, addr
+    // Jumps to the addr of V0 + nnn (or Vx + xnn).
+    template<bool readsVx> void OP_Bnnn_JP(Instruction const& instruction); // note, instruction looks like: JP V0, addr
     // Set Vx to: (random byte) AND kk.
-    void OP_Cxkk_RND(); // note, instruction looks like: RND Vx, byte
+    void OP_Cxkk_RND(Instruction const& instruction); // note, instruction looks like: RND Vx, byte
     // Displays n-byte sprite from I at (Vx, Vy), and sets VF to express a collision.
-    void OP_Dxyn_DRW(); // note, instruction looks like: DRW Vx, Vy, nibble
+    void OP_Dxyn_DRW(Instruction const& instruction); // note, instruction looks like: DRW Vx, Vy, nibble
     // Skips the next instruction if user presses the key with the value of Vx
-    void OP_Ex9E_SKP(); // note, instruction looks like: SKP Vx
+    void OP_Ex9E_SKP(Instruction const& instruction); // note, instruction looks like: SKP Vx
     // Skips the next instruction if user does not press the key with the value of Vx
-    void OP_ExA1_SKNP(); // note, instruction looks like: SKNP Vx
+    void OP_ExA1_SKNP(Instruction const& instruction); // note, instruction looks like: SKNP Vx
     // Sets Vx with a delay timer value
-    void OP_Fx07_LD(); // note, instruction looks like: LD Vx, DT
+    void OP_Fx07_LD(Instruction const& instruction); // note, instruction looks like: LD Vx, DT
     // Waits for a key press, then stores the value in Vx
-    void OP_Fx0A_LD(); // note, instruction looks like: LD Vx, K
+    void OP_Fx0A_LD(Instruction const& instruction); // note, instruction looks like: LD Vx, K
     // Sets the Delay timer to the value in Vx
-    void OP_Fx15_LD(); // note, instruction looks like: LD DT, Vx
+    void OP_Fx15_LD(Instruction const& instruction); // note, instruction looks like: LD DT, Vx
     // Sets the Sound timer to the value in Vx
-    void OP_Fx18_LD(); // note, instruction looks like: LD ST, Vx
+    void OP_Fx18_LD(Instruction const& instruction); // note, instruction looks like: LD ST, Vx
     // Adds the Index register with the value of Vx
-    void OP_Fx1E_ADD(); // note, instruction looks like: ADD I, Vx
+    void OP_Fx1E_ADD(Instruction const& instruction); // note, instruction looks like: ADD I, Vx
     // Set the index register with the address of the sprite representing a digit in Vx.
-    void OP_Fx29_LD(); // note, instruction looks like: LD F, Vx
+    void OP_Fx29_LD(Instruction const& instruction); // note, instruction looks like: LD F, Vx
     // Stores the Binary Coded Decimal (BCD) of Vx in locations I, I+1, and I+2.
-    void OP_Fx33_LD(); // note, instruction looks like: LD B, Vx
+    void OP_Fx33_LD(Instruction const& instruction); // note, instruction looks like: LD B, Vx
     // Stores registers V0 through Vx in memory, starting from location I
-    void OP_Fx55_LD(); // note, instruction looks like: LD [I], Vx
+    template<IndexQuirk indexQuirk> void OP_Fx55_LD(Instruction const& instruction); // note, instruction looks like: LD [I], Vx
     // Loads registers V0 through Vx from memory, starting from location I
-    void OP_Fx65_LD(); // note, instruction looks like: LD Vx, [I]
+    template<IndexQuirk indexQuirk> void OP_Fx65_LD(Instruction const& instruction); // note, instruction looks like: LD Vx, [I]
     
     ///
     //  Mappings opcode to opcode functions
     //
     
-    // Sets up the Pointer Table
-    // This array is used to index the mapped opcode functions using the opcode itself
-    void setUpPointerTable();
-    // Helpers for setUpPointerTable
-    void Table0();
-    void Table8();
-    void TableE();
-    void TableF();
-    void NULL_OP_DO_NOTHING();
-    
-    typedef void (Chip8::*opcodeTableFnPtr)();
-    // Create table arrays and initialize them to point to default function with an empty body
-    opcodeTableFnPtr table [0xF + 1] { &Chip8::NULL_OP_DO_NOTHING }; // main table pointer array
-    opcodeTableFnPtr table0[0xE + 1]{ &Chip8::NULL_OP_DO_NOTHING }; // nested table pointer array
-    opcodeTableFnPtr table8[0xE + 1]{ &Chip8::NULL_OP_DO_NOTHING }; // nested table pointer array
-    opcodeTableFnPtr tableE[0xE + 1]{ &Chip8::NULL_OP_DO_NOTHING }; // nested table pointer array
-    opcodeTableFnPtr tableF[0x65 + 1]{ &Chip8::NULL_OP_DO_NOTHING }; // nested table pointer array
+    // The Pointer Tables are used to index the mapped opcode functions using the opcode itself
+    // Helpers for the main table, each indexes a nested table
+    void Table0(Instruction const& instruction);
+    template<class Quirks> void Table8(Instruction const& instruction);
+    void TableE(Instruction const& instruction);
+    template<class Quirks> void TableF(Instruction const& instruction);
+    void NULL_OP_DO_NOTHING(Instruction const& instruction);
+    
+    typedef void (Chip8::*opcodeTableFnPtr)(Instruction const&);
+    // Table arrays, every entry without an opcode points at NULL_OP_DO_NOTHING
+    // each nested table covers every value of the digits that index it.
+    // Constant data initialized at compile time, shared by every instance.
+    // The tables that lead to a quirk are built once per profile
+    template<class Quirks>
+    struct Tables {
+        static const opcodeTableFnPtr table [0xF + 1]; // main table pointer array
+        static const opcodeTableFnPtr table8[0xF + 1]; // nested table pointer array
+        static const opcodeTableFnPtr tableF[0xFF + 1]; // nested table pointer array
+    };
+    static const opcodeTableFnPtr table0[0xF + 1]; // nested table pointer array
+    static const opcodeTableFnPtr tableE[0xF + 1]; // nested table pointer array
+    opcodeTableFnPtr const* mainTable; // main table of this machine's profile
     
+    // Resolves an opcode through the nested tables of a profile to the function that executes it
+    static opcodeTableFnPtr lookup(uint16_t opcode, QuirkProfile profile);
+    template<class Quirks> static opcodeTableFnPtr lookupIn(uint16_t opcode);
+    // Same, with this machine's profile
+    opcodeTableFnPtr lookup(uint16_t opcode) const;
+    
+#if defined(CHIP8_FLAT_DISPATCH)
+    // Every 16 bit opcode mapped straight to its function and operands, one indirect call per instruction.
+    // Built once per profile and shared by all instances
+    struct FlatEntry {
+        opcodeTableFnPtr function;
+        Instruction instruction;
+    };
+    FlatEntry const* flatTable;
+    template<class Quirks> static FlatEntry const* sharedFlatTable();
+#endif
+    
+#if defined(CHIP8_PREDECODE_DISPATCH)
+    // Every function an opcode can resolve to, numbered so a cache entry needs one byte for it.
+    // Built once and shared by all instances
+    struct HandlerTable {
+        std::vector<opcodeTableFnPtr> functions; // functions[0] is nullptr, for an entry not decoded yet
+        std::vector<uint8_t> numbers; // each 16 bit opcode's function, as its index into functions
+    };
+    HandlerTable const* handlerTable;
+    template<class Quirks> static HandlerTable const* sharedHandlerTable();
+    // The opcode at every address of memory and the number of its function, decoded on first execution.
+    // Entries are cleared when memory under them is written, so self modifying code still works.
+    // Four bytes each, so the cache adds 16K to a machine and copies of it stay cheap
+    struct DecodedEntry {
+        uint8_t  handler; // index into handlerTable->functions, 0 until decoded
+        uint16_t opcode;
+    };
+    DecodedEntry decodeCache[MEMORY_SIZE]{};
+#endif
 };
 
 #endif
@@ -0,0 +1,101 @@
+#include "emulation.h"
+
+#include <cstring>
+
+EmulationThread::EmulationThread(Chip8& device, Scheduler& scheduler, RewindBuffer* rewind, MovieRecorder* recorder,
+                                 std::function<void()> onFrame, std::function<void(unsigned long long, bool)> onSound)
+    : device(device), scheduler(scheduler), rewind(rewind), recorder(recorder), onFrame(onFrame), onSound(onSound),
+      pacer(Scheduler::framePeriod()), keys(0), unseenSequence(0), rewinding(false), stopping(false) {
+    thread = std::thread(&EmulationThread::run, this);
+}
+
+EmulationThread::~EmulationThread(){
+    stop();
+}
+
+void EmulationThread::setKeys(uint8_t const* keypad, uint16_t sequence){
+    // One word, so a frame never sees the keys of one change with the sequence of another
+    uint32_t mask = static_cast<uint32_t>(sequence) << 16u;
+    for (unsigned int key = 0; key < 16; ++key)
+        mask |= (keypad[key] ? 1u : 0u) << key;
+    keys.store(mask, std::memory_order_relaxed);
+}
+
+void EmulationThread::setRewinding(bool rewinding){
+    this->rewinding.store(rewinding, std::memory_order_relaxed);
+}
+
+DisplayFrame const* EmulationThread::takeFrame(){
+    return frames.update() ? &frames.read() : nullptr;
+}
+
+uint16_t EmulationThread::getUnseenSequence() const {
+    return unseenSequence.load(std::memory_order_acquire);
+}
+
+void EmulationThread::stop(){
+    stopping.store(true, std::memory_order_relaxed);
+    if (thread.joinable())
+        thread.join();
+}
+
+FramePacer const& EmulationThread::getPacer() const {
+    return pacer;
+}
+
+void EmulationThread::run(){
+    unsigned long long frame = 0;
+    bool sounding = false;
+    uint16_t ranSequence = 0; // the sequence the last frame ran with
+    pacer.resync();
+    for (; !stopping.load(std::memory_order_relaxed); ++frame){
+        // Sleeps until the frame starts. An idle program costs a few instructions a frame,
+        // so the loop keeps its pace rather than blocking until a key changes
+        pacer.wait();
+
+        // One recorded frame back per frame, keys stay as they are held now
+        bool back = rewind && rewinding.load(std::memory_order_relaxed);
+        if (back)
+            rewind->stepBack();
+        // Keys are read as late as they can be, right before the frame that uses them
+        uint32_t held = keys.load(std::memory_order_relaxed);
+        uint16_t sequence = static_cast<uint16_t>(held >> 16u);
+        FramePacer::clk::time_point sampled = FramePacer::clk::now();
+        for (unsigned int key = 0; key < 16; ++key)
+            device.keypad[key] = (held >> key) & 1u;
+
+        if (!back){
+            if (recorder)
+                recorder->record(scheduler.getCycles(), device.keypad);
+            // One frame of emulated time
+            scheduler.runFrame(pacer.getDeadline());
+            if (rewind)
+                rewind->push();
+        }
+
+        // The buzzer sounds while the sound timer runs, not while rewinding
+        bool sound = !back && device.isSoundOn();
+        if (onSound && sound != sounding)
+            onSound(frame, sound);
+        sounding = sound;
+
+        if (device.isDisplayDirty()){
+            DisplayFrame& published = frames.write();
+            std::memcpy(published.displayMemory, device.displayMemory, sizeof(published.displayMemory));
+            published.cycle = scheduler.getCycles();
+            published.inputSequence = sequence;
+            published.sampled = sampled;
+            frames.publish();
+            device.clearDisplayDirty();
+            if (onFrame)
+                onFrame();
+        }
+        // The first frame with new keys showed nothing of them. Released after any frame published
+        // before it, so the drawing thread can't miss one of those once it sees this
+        else if (sequence != ranSequence)
+            unseenSequence.store(sequence, std::memory_order_release);
+        ranSequence = sequence;
+    }
+    if (onSound && sounding)
+        onSound(frame, false);
+}
@@ -0,0 +1,76 @@
+#ifndef EMULATION_HEADER
+#define EMULATION_HEADER
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "chip8.h"
+#include "movie.h"
+#include "pacer.h"
+#include "rewind.h"
+#include "scheduler.h"
+#include "triplebuffer.h"
+
+// The display as it was at the end of a frame
+struct DisplayFrame {
+    uint64_t displayMemory[VIDEO_HEIGHT];
+    unsigned long long cycle; // Scheduler::getCycles() at the end of the frame
+    uint16_t inputSequence; // the sequence the frame's keys were set with
+    std::chrono::steady_clock::time_point sampled; // when the frame read its keys
+};
+
+// Runs a machine one frame per 1/60 s on a thread of its own, so a slow present on the thread
+// that draws (vsync, a driver stall) never holds up emulated time.
+// Keys come in through an atomic mask and every frame that changed the display goes out through
+// a triple buffer, neither thread ever waits on the other. While it runs the device, scheduler,
+// rewind buffer and recorder belong to the emulation thread, touch them again only after stop()
+class EmulationThread {
+public:
+    // rewind and recorder may be nullptr. onFrame is called on the emulation thread after each
+    // frame that changed the display was published, e.g. to wake the drawing thread up.
+    // onSound, when given, is called there with the frame at which the buzzer starts or stops
+    EmulationThread(Chip8& device, Scheduler& scheduler, RewindBuffer* rewind, MovieRecorder* recorder,
+                    std::function<void()> onFrame, std::function<void(unsigned long long, bool)> onSound = nullptr);
+    ~EmulationThread();
+
+    // Any thread: the keys the next frame runs with. sequence comes back on the frames run with them,
+    // to tell when a key change first reached the screen
+    void setKeys(uint8_t const* keypad, uint16_t sequence = 0);
+    // Any thread: while set, each frame steps one recorded frame back instead of running
+    void setRewinding(bool rewinding);
+
+    // Drawing thread: the newest frame when one was published since the last call, nullptr otherwise.
+    // It stays valid until the next call
+    DisplayFrame const* takeFrame();
+    // Any thread: the newest sequence whose first frame changed nothing on screen, so no frame will
+    // ever carry it. Read it before takeFrame(), every frame published ahead of it is then taken
+    uint16_t getUnseenSequence() const;
+
+    // Finishes the frame being run and joins the thread
+    void stop();
+    // The pacing statistics of the emulation thread, once stopped
+    FramePacer const& getPacer() const;
+
+private:
+    void run();
+
+    Chip8& device;
+    Scheduler& scheduler;
+    RewindBuffer* rewind;
+    MovieRecorder* recorder;
+    std::function<void()> onFrame;
+    std::function<void(unsigned long long, bool)> onSound;
+    FramePacer pacer;
+
+    std::atomic<uint32_t> keys; // bit k set while key k is held, the sequence in the top 16 bits
+    std::atomic<uint16_t> unseenSequence;
+    std::atomic<bool> rewinding;
+    std::atomic<bool> stopping;
+    TripleBuffer<DisplayFrame> frames;
+    std::thread thread;
+};
+
+#endif
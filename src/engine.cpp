@@ -1,14 +1,16 @@
 #include "engine.h"
 Engine::Engine(char const* title,
                    int windowWidth, int windowHeight,
-                   int textureWidth, int textureHeight){
+                   int textureWidth, int textureHeight,
+                   bool softwareRenderer) : textureWidth(textureWidth){
     // Initialize SDL for using SDL function
     SDL_Init(SDL_INIT_VIDEO);
     // Window settings
     window = SDL_CreateWindow(title, 0, 0, windowWidth, windowHeight, SDL_WINDOW_SHOWN);
     // 2D rendering context using hardware acceleration
     // note, each driver (e.g. OpenGL, Direct3d, Software,…) is indexed in SDL 2.0 thus SDL uses -1 to pick one for us
-    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    // the software renderer is for hosts without a GPU, it is given a texture already scaled to the window
+    renderer = SDL_CreateRenderer(window, -1, softwareRenderer ? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
     
     texture = SDL_CreateTexture(
         renderer, SDL_PIXELFORMAT_RGBA8888 /*pixel format*/,
@@ -16,6 +18,9 @@ Engine::Engine(char const* title,
                             textureWidth, textureHeight);
     
     quit_flag = false;
+    redraw_flag = true;
+    rewind_flag = false;
+    wake_event = SDL_RegisterEvents(1);
 }
 
 Engine::~Engine() {
@@ -30,135 +35,92 @@ void Engine::update(void const* buffer, int pitch) {
     // Updating the window
     // update given texture rectangle with new pixel data.
     SDL_UpdateTexture(texture, nullptr /*entire texture area*/, buffer, pitch /*nr of bytes per row in buffer*/);
+    present();
+}
+
+void Engine::update(void const* buffer, int pitch, int firstRow, int rowCount) {
+    // update only the changed rows of the texture
+    SDL_Rect rows = { 0, firstRow, textureWidth, rowCount };
+    SDL_UpdateTexture(texture, &rows, buffer, pitch /*nr of bytes per row in buffer*/);
+    present();
+}
+
+void Engine::present() {
     SDL_RenderClear(renderer); // ignores the viewport
     // Copy texture to the current rendering target
     SDL_RenderCopy(renderer, texture,
                    nullptr /*entire source (texture) area*/,
                    nullptr /*entire target area*/);
     SDL_RenderPresent(renderer);
+    redraw_flag = false;
+}
+
+bool Engine::needsRedraw() {
+    return redraw_flag;
 }
 
 void Engine::processInput(uint8_t* keys) {
     SDL_Event event; // receive input from the user
 
-    while (SDL_PollEvent(&event)) { // read all from event queue
-        switch (event.type) {
-            case SDL_QUIT:
+    while (SDL_PollEvent(&event)) // read all from event queue
+        handleEvent(event, keys);
+}
+
+void Engine::waitForInput(uint8_t* keys, int timeoutMs) {
+    SDL_Event event;
+
+    // Blocks in the OS rather than spinning
+    if (SDL_WaitEventTimeout(&event, timeoutMs))
+        handleEvent(event, keys);
+    processInput(keys);
+}
+
+void Engine::wake() {
+    // SDL's event queue may be pushed to from any thread, handleEvent() ignores the event itself
+    SDL_Event event{};
+    event.type = wake_event;
+    SDL_PushEvent(&event);
+}
+
+void Engine::handleEvent(SDL_Event const& event, uint8_t* keys) {
+    switch (event.type) {
+        case SDL_QUIT:
+            quit_flag = true;
+            break;
+        case SDL_WINDOWEVENT:
+            // The window system may have discarded what was last presented
+            if (event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+                event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED ||
+                event.window.event == SDL_WINDOWEVENT_RESTORED)
+                redraw_flag = true;
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP: {
+            // special key strokes, these can't be remapped
+            bool down = event.type == SDL_KEYDOWN;
+            SDL_Scancode scancode = event.key.keysym.scancode;
+            if (scancode == SDL_SCANCODE_ESCAPE && down)
                 quit_flag = true;
-                break;
-            case SDL_KEYDOWN: {
-                switch (event.key.keysym.sym) {
-                    case SDLK_ESCAPE:
-                        quit_flag = true;
-                        break;
-                    case SDLK_x:
-                        keys[0] = 1;
-                        break;
-                    case SDLK_1:
-                        keys[1] = 1;
-                        break;
-                    case SDLK_2:
-                        keys[2] = 1;
-                        break;
-                    case SDLK_3:
-                        keys[3] = 1;
-                        break;
-                    case SDLK_q:
-                        keys[4] = 1;
-                        break;
-                    case SDLK_w:
-                        keys[5] = 1;
-                        break;
-                    case SDLK_e:
-                        keys[6] = 1;
-                        break;
-                    case SDLK_a:
-                        keys[7] = 1;
-                        break;
-                    case SDLK_s:
-                        keys[8] = 1;
-                        break;
-                    case SDLK_d:
-                        keys[9] = 1;
-                        break;
-                    case SDLK_z:
-                        keys[0xA] = 1;
-                        break;
-                    case SDLK_c:
-                        keys[0xB] = 1;
-                        break;
-                    case SDLK_4:
-                        keys[0xC] = 1;
-                        break;
-                    case SDLK_r:
-                        keys[0xD] = 1;
-                        break;
-                    case SDLK_f:
-                        keys[0xE] = 1;
-                        break;
-                    case SDLK_v:
-                        keys[0xF] = 1;
-                        break;
-                    }
-            } // ends nested switch
-                break; // ends case SDL_KEYDOWN
-            case SDL_KEYUP:
-                switch (event.key.keysym.sym) {// special key strokes
-                    case SDLK_x:
-                        keys[0] = 0;
-                        break;
-                    case SDLK_1:
-                        keys[1] = 0;
-                        break;
-                    case SDLK_2:
-                        keys[2] = 0;
-                        break;
-                    case SDLK_3:
-                        keys[3] = 0;
-                        break;
-                    case SDLK_q:
-                        keys[4] = 0;
-                        break;
-                    case SDLK_w:
-                        keys[5] = 0;
-                        break;
-                    case SDLK_e:
-                        keys[6] = 0;
-                        break;
-                    case SDLK_a:
-                        keys[7] = 0;
-                        break;
-                    case SDLK_s:
-                        keys[8] = 0;
-                        break;
-                    case SDLK_d:
-                        keys[9] = 0;
-                        break;
-                    case SDLK_z:
-                        keys[0xA] = 0;
-                        break;
-                    case SDLK_c:
-                        keys[0xB] = 0;
-                        break;
-                    case SDLK_4:
-                        keys[0xC] = 0;
-                        break;
-                    case SDLK_r:
-                        keys[0xD] = 0;
-                        break;
-                    case SDLK_f:
-                        keys[0xE] = 0;
-                        break;
+            else if (scancode == SDL_SCANCODE_BACKSPACE)
+                rewind_flag = down;
+            else {
+                int key = keymap.lookup(scancode);
+                if (key != KeyMap::UNMAPPED)
+                    keys[key] = down ? 1 : 0;
+            }
+        }
+            break; // ends case SDL_KEYDOWN, SDL_KEYUP
+    } // ends outer switch body
+}
 
-                    case SDLK_v:
-                        keys[0xF] = 0;
-                        break;
-                } // end nested switch
-                break; // ends case SDL_KEYDOWN
-        } // ends outer switch body
-    } // end while loop
+void Engine::setKeyMap(KeyMap const& map) {
+    keymap = map;
 }
 
 bool Engine::getQuitFlag(){
     return quit_flag;
 }
+
+bool Engine::isRewinding(){
+    return rewind_flag;
+}
@@ -1,20 +1,43 @@
 #include <SDL2/SDL.h>
+#include "keymap.h"
 
 class Engine { // using the SDL framework, this class is responsible for the graphics renderer, setting up the window and handling the input events
     SDL_Window* window{};
     SDL_Renderer* renderer{};
     SDL_Texture* texture{};
+    int textureWidth;
     
     bool quit_flag;
+    bool redraw_flag; // window contents were lost (e.g. exposed) and must be presented again
+    bool rewind_flag; // backspace is held
+    Uint32 wake_event; // event type wake() pushes
+    KeyMap keymap; // which keypad key each host key presses
+    
+    void handleEvent(SDL_Event const& event, uint8_t* keys);
 public:
     Engine(char const* title,
              int windowWidth, int windowHeight,
-             int textureWidth, int textureHeight);
+             int textureWidth, int textureHeight,
+             bool softwareRenderer = false);
     ~Engine();
 
     // Update window
     void update(void const* buffer, int pitch);
+    // Update only rows [firstRow, firstRow + rowCount) of the texture, buffer points at firstRow
+    void update(void const* buffer, int pitch, int firstRow, int rowCount);
+    // Present the texture again without uploading anything
+    void present();
+    // True when the window needs presenting even though nothing was drawn
+    bool needsRedraw();
     // key input handler
     void processInput(uint8_t* keys);
+    // Sleeps until an event arrives or the timeout passes, then handles every pending event
+    void waitForInput(uint8_t* keys, int timeoutMs);
+    // Replaces the default key layout
+    void setKeyMap(KeyMap const& map);
+    // Safe from any thread: makes a waitForInput() that is blocked return now
+    void wake();
     bool getQuitFlag();
+    // True while the rewind key (backspace) is held
+    bool isRewinding();
 };
@@ -0,0 +1,17 @@
+#ifndef HASH_HEADER
+#define HASH_HEADER
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit FNV-1a hash, used to fingerprint framebuffers and ROM images
+inline uint64_t fnv1a(void const* data, size_t size, uint64_t hash = 0xCBF29CE484222325ull){
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    for (size_t i = 0; i < size; ++i){
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+#endif
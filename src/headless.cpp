@@ -0,0 +1,366 @@
+#include "batch.h"
+#include "chip8.h"
+#include "hash.h"
+#include "movie.h"
+#include "pool.h"
+#include "profiler.h"
+#include "romstore.h"
+#include "scheduler.h"
+#include "snapshot.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <set>
+#include <string>
+
+// Runs a ROM without a window, input or any throttling.
+// Intended for regression and fuzz runs, and for measuring raw interpreter throughput.
+static void usage(char const* program){
+    std::cerr << "usage: " << program << " [--cycles N] [--ips N] [--recompile] [--verify] [--instances N] [--threads N] [--batch] [--load-state FILE] [--save-state FILE] [--seed N] [--random standard|xorshift] [--quirks default|vip|chip48|schip] [--replay FILE] [--profile FILE] [path to rom]" << std::endl;
+    std::cerr << " - --cycles defaults to 10000000" << std::endl;
+    std::cerr << " - --ips sets the emulated instructions per second (default 600), timers tick once per 1/60 s of emulated time" << std::endl;
+    std::cerr << " - --recompile executes translated blocks instead of interpreting each instruction" << std::endl;
+    std::cerr << " - --verify also runs an interpreter alongside and stops at the first frame where their states differ" << std::endl;
+    std::cerr << " - --instances runs that many copies of the rom in an EmulatorPool, each with its own random seed" << std::endl;
+    std::cerr << "   and a budget of --cycles instructions. --threads sets the pool's workers (default one per core)" << std::endl;
+    std::cerr << " - --batch runs the instances in lockstep on one thread in a BatchEngine instead,"<< std::endl;
+    std::cerr << "   --verify then checks every lane against its own interpreter" << std::endl;
+    std::cerr << " - --load-state starts from a saved snapshot instead of the rom's first instruction," << std::endl;
+    std::cerr << "   --save-state writes a snapshot of the final state (single instance only)" << std::endl;
+    std::cerr << " - --seed seeds the random generator (instance i of a pool or batch gets N + i) instead of the clock" << std::endl;
+    std::cerr << " - --random chooses the generator behind RND, xorshift is cheaper (default standard)" << std::endl;
+    std::cerr << " - --quirks runs the rom as the COSMAC VIP, CHIP-48 or SUPER-CHIP would, where they disagree (default this emulator's own)" << std::endl;
+    std::cerr << " - --replay feeds an input movie recorded by the emulator back in, with its seed, quirks and instruction rate," << std::endl;
+    std::cerr << "   runs to its end and checks the final display against the recording (exit code 3 when it differs)" << std::endl;
+    std::cerr << " - --profile counts every instruction by handler and by address, and times a sample of the handlers," << std::endl;
+    std::cerr << "   then writes them to FILE as JSON (.json) or CSV. Needs a build with make PROFILE=1, interpreter only" << std::endl;
+    std::cerr << " - the run also stops early once the program halts (jump to self, or waits for a key)" << std::endl;
+}
+
+// Frames run on every instance per pool tick, one second of emulated time
+const unsigned int POOL_TICK_FRAMES = 60;
+
+// Runs many copies of the rom at once and reports the aggregate throughput
+static int runPool(RomImage const& rom, unsigned long long maxCycles, unsigned int instructionsPerSecond,
+                   ExecutionMode mode, size_t instances, unsigned int threads, bool seeded, uint64_t seed,
+                   RandomGenerator generator, QuirkProfile quirks){
+    EmulatorPool pool(threads, instructionsPerSecond, mode);
+    pool.setInstructionBudget(maxCycles);
+    for (size_t i = 0; i < instances; ++i){
+        Chip8 machine(rom);
+        machine.setQuirkProfile(quirks);
+        machine.setRandomGenerator(generator);
+        if (seeded)
+            machine.seedRandom(seed + i);
+        pool.add(machine);
+    }
+
+    // Tick until every instance used up its budget or halted, a budget of 0 runs nothing as a single instance does
+    size_t running = maxCycles > 0 ? instances : 0;
+    while (running > 0){
+        pool.tick(POOL_TICK_FRAMES);
+        running = 0;
+        for (size_t i = 0; i < pool.size(); ++i)
+            running += pool.isRunning(i);
+    }
+
+    size_t halted = 0;
+    unsigned long long idleFrames = 0;
+    unsigned long long frames = 0;
+    std::set<uint64_t> displays;
+    for (size_t i = 0; i < pool.size(); ++i){
+        EmulatorPool::InstanceStats const& stats = pool.getStats(i);
+        halted += stats.halted;
+        idleFrames += stats.idleFrames;
+        frames += stats.frames;
+        displays.insert(fnv1a(pool.getInstance(i).displayMemory, sizeof(pool.getInstance(i).displayMemory)));
+    }
+
+    std::cout << "rom:       " << rom.getPath() << std::endl;
+    std::cout << "dispatch:  " << Chip8::dispatchName() << (mode == RECOMPILER ? " (recompiled)" : "") << std::endl;
+    std::cout << "quirks:    " << Chip8::quirkProfileName(quirks) << std::endl;
+    std::cout << "instances: " << pool.size() << " on " << pool.getThreadCount() << " threads" << std::endl;
+    std::cout << "cycles:    " << pool.getTotalInstructions() << " (" << halted << " instances halted)" << std::endl;
+    std::cout << "frames:    " << frames << " (" << idleFrames << " ended idle)" << std::endl;
+    std::cout << "cycles/s:  " << std::fixed << std::setprecision(0) << pool.getInstructionsPerSecond() << std::endl;
+    std::cout << "displays:  " << displays.size() << " distinct" << std::endl;
+
+    // Small pools also list each instance
+    const size_t LISTED_INSTANCES = 16;
+    for (size_t i = 0; i < pool.size() && pool.size() <= LISTED_INSTANCES; ++i){
+        EmulatorPool::InstanceStats const& stats = pool.getStats(i);
+        uint64_t hash = fnv1a(pool.getInstance(i).displayMemory, sizeof(pool.getInstance(i).displayMemory));
+        std::cout << std::dec << std::setw(4) << std::setfill(' ') << i << ": " << stats.instructions << " cycles, "
+                  << stats.frames << " frames" << (stats.halted ? " (halted)" : "")
+                  << ", display 0x" << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+    }
+    return 0;
+}
+
+// Runs many copies of the rom in lockstep and reports how much ran vectorized
+static int runBatch(RomImage const& rom, unsigned long long maxCycles, unsigned int instructionsPerSecond,
+                    size_t instances, bool verify, bool seeded, uint64_t seed, RandomGenerator generator, QuirkProfile quirks){
+    std::vector<Chip8> machines;
+    for (size_t i = 0; i < instances; ++i){
+        machines.emplace_back(rom);
+        machines.back().setQuirkProfile(quirks);
+        machines.back().setRandomGenerator(generator);
+        if (seeded)
+            machines.back().seedRandom(seed + i);
+    }
+    BatchEngine batch(machines, instructionsPerSecond);
+
+    // Each lane's reference starts as an exact copy, including the random generator
+    std::vector<Chip8> references;
+    std::vector<std::unique_ptr<Scheduler>> referenceSchedulers;
+    if (verify){
+        references = machines;
+        for (Chip8& reference : references)
+            referenceSchedulers.emplace_back(new Scheduler(reference, instructionsPerSecond));
+    }
+
+    typedef std::chrono::steady_clock clk;
+    auto start = clk::now();
+
+    unsigned long long cycles = 0;
+    unsigned long long frames = 0;
+    size_t halted = 0;
+    while (cycles < maxCycles * instances && halted < instances){
+        cycles += batch.runFrame();
+        ++frames;
+        if (verify){
+            for (size_t i = 0; i < instances; ++i){
+                referenceSchedulers[i]->runFrame();
+                if (!batch.getLane(i).matches(references[i])){
+                    std::cerr << "Lane " << i << " differs from its interpreter after frame " << frames << std::endl;
+                    return 2;
+                }
+            }
+        }
+        // Looking at every lane syncs it, so only check once a second of emulated time
+        if (frames % POOL_TICK_FRAMES == 0){
+            halted = 0;
+            for (size_t i = 0; i < instances; ++i)
+                halted += batch.getLane(i).isHalted();
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(clk::now() - start).count();
+    std::set<uint64_t> displays;
+    for (size_t i = 0; i < instances; ++i)
+        displays.insert(fnv1a(batch.getLane(i).displayMemory, sizeof(batch.getLane(i).displayMemory)));
+    unsigned long long vector = batch.getVectorInstructions();
+    unsigned long long total = vector + batch.getScalarInstructions();
+
+    std::cout << "rom:       " << rom.getPath() << std::endl;
+    std::cout << "dispatch:  " << Chip8::dispatchName() << " (lockstep batch)" << std::endl;
+    std::cout << "quirks:    " << Chip8::quirkProfileName(quirks) << std::endl;
+    std::cout << "instances: " << instances << std::endl;
+    std::cout << "cycles:    " << cycles << " (" << halted << " instances halted)" << std::endl;
+    std::cout << "frames:    " << frames << std::endl;
+    std::cout << "vector:    " << std::fixed << std::setprecision(1) << (total > 0 ? 100.0 * vector / total : 0.0) << "% of instructions" << std::endl;
+    std::cout << "cycles/s:  " << std::setprecision(0) << (seconds > 0 ? cycles / seconds : 0.0) << std::endl;
+    std::cout << "displays:  " << displays.size() << " distinct" << std::endl;
+    if (verify)
+        std::cout << "verify:    every lane matches its interpreter" << std::endl;
+    return 0;
+}
+
+int main (int argc, char* argv[]){
+    unsigned long long maxCycles = 10000000ull;
+    unsigned int instructionsPerSecond = 600;
+    ExecutionMode mode = INTERPRETER;
+    bool verify = false;
+    size_t instances = 1;
+    unsigned int threads = 0;
+    bool batch = false;
+    char const* loadState = nullptr;
+    char const* saveState = nullptr;
+    bool seeded = false;
+    uint64_t seed = 0;
+    char const* replay = nullptr;
+    RandomGenerator generator = STANDARD_GENERATOR;
+    QuirkProfile quirks = DEFAULT_QUIRKS;
+    char const* profile = nullptr;
+    char const* path = "roms/tetris.ch8";
+
+    for (int i = 1; i < argc; ++i){
+        if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+            maxCycles = std::strtoull(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--ips") == 0 && i + 1 < argc)
+            instructionsPerSecond = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--recompile") == 0)
+            mode = RECOMPILER;
+        else if (std::strcmp(argv[i], "--verify") == 0)
+            verify = true;
+        else if (std::strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+            instances = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            threads = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--batch") == 0)
+            batch = true;
+        else if (std::strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+            loadState = argv[++i];
+        else if (std::strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+            saveState = argv[++i];
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+            seed = std::strtoull(argv[++i], nullptr, 10);
+            seeded = true;
+        }
+        else if (std::strcmp(argv[i], "--random") == 0 && i + 1 < argc && std::strcmp(argv[i + 1], "standard") == 0){
+            generator = STANDARD_GENERATOR;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--random") == 0 && i + 1 < argc && std::strcmp(argv[i + 1], "xorshift") == 0){
+            generator = XORSHIFT_GENERATOR;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc && Chip8::findQuirkProfile(argv[i + 1], &quirks))
+            ++i;
+        else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay = argv[++i];
+        else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profile = argv[++i];
+        else if (argv[i][0] == '-'){
+            usage(argv[0]);
+            return 1;
+        }
+        else
+            path = argv[i];
+    }
+
+    // Mapped once, every instance is copied from the same image
+    std::string error;
+    std::shared_ptr<RomImage const> rom = RomStore::shared().open(path, &error);
+    if (!rom){
+        std::cerr << "Could not load rom: " << error << std::endl;
+        return 1;
+    }
+
+    if (instances == 0 || (instances > 1 && verify && !batch) || (batch && mode == RECOMPILER)
+        || (instances > 1 && (loadState || saveState || replay || profile)) || (replay && (loadState || seeded))
+        || (profile && mode == RECOMPILER)){
+        usage(argv[0]);
+        return 1;
+    }
+#if !defined(CHIP8_PROFILE)
+    if (profile){
+        std::cerr << "--profile needs a build with profiling compiled in (make headless PROFILE=1)" << std::endl;
+        return 1;
+    }
+#endif
+    if (batch)
+        return runBatch(*rom, maxCycles, instructionsPerSecond, instances, verify, seeded, seed, generator, quirks);
+    if (instances > 1)
+        return runPool(*rom, maxCycles, instructionsPerSecond, mode, instances, threads, seeded, seed, generator, quirks);
+
+    // A replay brings its own seed, quirks and instruction rate
+    std::ifstream movie;
+    std::unique_ptr<MoviePlayer> player;
+    if (replay){
+        movie.open(replay, std::ios::binary);
+        player.reset(new MoviePlayer(movie));
+        if (!player->isValid()){
+            std::cerr << "Could not read an input movie from \"" << replay << "\"" << std::endl;
+            return 1;
+        }
+        seeded = true;
+        seed = player->getSeed();
+        generator = player->getRandomGenerator();
+        quirks = player->getQuirkProfile();
+        instructionsPerSecond = player->getInstructionsPerSecond();
+    }
+
+    Chip8 device(*rom);
+    device.setQuirkProfile(quirks);
+    device.setRandomGenerator(generator);
+    if (seeded)
+        device.seedRandom(seed);
+    Snapshotter snapshotter(device);
+    if (loadState){
+        std::ifstream in(loadState, std::ios::binary);
+        Snapshot snapshot;
+        if (!Snapshotter::load(in, snapshot)){
+            std::cerr << "Could not load a snapshot from \"" << loadState << "\"" << std::endl;
+            return 1;
+        }
+        snapshotter.restore(snapshot);
+    }
+    Scheduler scheduler(device, instructionsPerSecond, mode);
+    // Starts as an exact copy, including the random generator
+    Chip8 reference = device;
+    Scheduler referenceScheduler(reference, instructionsPerSecond);
+#if defined(CHIP8_PROFILE)
+    // Attached after the reference was copied, so only the device is counted
+    Profiler profiler;
+    if (profile)
+        device.setProfiler(&profiler);
+#endif
+
+    typedef std::chrono::steady_clock clk;
+    auto start = clk::now();
+
+    // Frames run back to back, emulated time is only bounded by the host
+    unsigned long long cycles = 0;
+    unsigned long long frames = 0;
+    bool halted = false;
+    while (player ? !(player->isFinished() && cycles >= player->getEndCycle()) : cycles < maxCycles){
+        if (player){
+            player->apply(cycles, device.keypad);
+            std::memcpy(reference.keypad, device.keypad, sizeof(reference.keypad));
+        }
+        // The last frame stops at the cycle limit rather than running its whole budget, a movie sets its own end
+        unsigned long limit = player || maxCycles - cycles > ULONG_MAX ? ULONG_MAX : maxCycles - cycles;
+        cycles += scheduler.runFrame(limit);
+        ++frames;
+        if (verify){
+            referenceScheduler.runFrame(limit);
+            if (!device.matches(reference)){
+                std::cerr << "State differs from the interpreter after frame " << frames << " (" << cycles << " cycles)" << std::endl;
+                return 2;
+            }
+        }
+        // A program waiting on a key isn't stuck while the movie still has keys to press
+        if (device.isHalted() && (!player || player->isFinished())){
+            halted = true;
+            break;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(clk::now() - start).count();
+    uint64_t hash = fnv1a(device.displayMemory, sizeof(device.displayMemory));
+
+    std::cout << "rom:      " << path << std::endl;
+    std::cout << "dispatch: " << Chip8::dispatchName() << (mode == RECOMPILER ? " (recompiled)" : "") << std::endl;
+    std::cout << "quirks:   " << Chip8::quirkProfileName(quirks) << std::endl;
+    std::cout << "cycles:   " << cycles << (halted ? " (halted)" : player ? " (end of movie)" : " (cycle limit)") << std::endl;
+    std::cout << "frames:   " << frames << " (" << scheduler.getInstructionsPerFrame() << " instructions each)" << std::endl;
+    std::cout << "elapsed:  " << std::fixed << std::setprecision(3) << seconds * 1000.0 << " ms" << std::endl;
+    std::cout << "cycles/s: " << std::setprecision(0) << (seconds > 0 ? cycles / seconds : 0.0) << std::endl;
+    if (verify)
+        std::cout << "verify:   matches the interpreter" << std::endl;
+    std::cout << "display:  0x" << std::hex << std::setw(16) << std::setfill('0') << hash << std::endl;
+    bool replayMatches = !player || (cycles == player->getEndCycle() && hash == player->getDisplayHash());
+    if (player)
+        std::cout << "replay:   " << (replayMatches ? "matches the recording" : "differs from the recording") << std::endl;
+
+#if defined(CHIP8_PROFILE)
+    if (profile && !profiler.write(device, profile)){
+        std::cerr << "Could not write a profile to \"" << profile << "\"" << std::endl;
+        return 1;
+    }
+#endif
+    if (saveState){
+        std::ofstream out(saveState, std::ios::binary);
+        Snapshotter::save(snapshotter.take(), out);
+        if (!out){
+            std::cerr << "Could not write a snapshot to \"" << saveState << "\"" << std::endl;
+            return 1;
+        }
+    }
+    return replayMatches ? 0 : 3;
+}
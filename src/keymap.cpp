@@ -0,0 +1,72 @@
+#include "keymap.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+
+// The keypad laid over the left of a QWERTY keyboard
+//  Keypad       Keyboard
+//  1 2 3 C      1 2 3 4
+//  4 5 6 D      Q W E R
+//  7 8 9 E      A S D F
+//  A 0 B F      Z X C V
+static const struct {
+    SDL_Scancode scancode;
+    int8_t key;
+} DEFAULT_LAYOUT[] = {
+    { SDL_SCANCODE_X, 0x0 }, { SDL_SCANCODE_1, 0x1 }, { SDL_SCANCODE_2, 0x2 }, { SDL_SCANCODE_3, 0x3 },
+    { SDL_SCANCODE_Q, 0x4 }, { SDL_SCANCODE_W, 0x5 }, { SDL_SCANCODE_E, 0x6 }, { SDL_SCANCODE_A, 0x7 },
+    { SDL_SCANCODE_S, 0x8 }, { SDL_SCANCODE_D, 0x9 }, { SDL_SCANCODE_Z, 0xA }, { SDL_SCANCODE_C, 0xB },
+    { SDL_SCANCODE_4, 0xC }, { SDL_SCANCODE_R, 0xD }, { SDL_SCANCODE_F, 0xE }, { SDL_SCANCODE_V, 0xF },
+};
+
+KeyMap::KeyMap(){
+    for (int8_t& key : table)
+        key = UNMAPPED;
+    for (auto const& entry : DEFAULT_LAYOUT)
+        table[entry.scancode] = entry.key;
+}
+
+bool KeyMap::load(char const* path, std::string* error){
+    std::ifstream file(path);
+    if (!file.is_open()){
+        if (error)
+            *error = std::string("\"") + path + "\" can't be opened";
+        return false;
+    }
+
+    int8_t loaded[SDL_NUM_SCANCODES];
+    for (int8_t& key : loaded)
+        key = UNMAPPED;
+
+    std::string line;
+    for (unsigned int number = 1; std::getline(file, line); ++number){
+        // Trailing carriage returns and spaces are not part of a key's name
+        size_t end = line.find_last_not_of(" \t\r");
+        size_t begin = line.find_first_not_of(" \t");
+        if (end == std::string::npos || line[begin] == '#')
+            continue;
+        line = line.substr(begin, end - begin + 1);
+
+        // The keypad digit, then the rest of the line names the host key, names may have spaces ("Left Shift")
+        char* digitEnd = nullptr;
+        long key = std::strtol(line.c_str(), &digitEnd, 16);
+        size_t nameBegin = line.find_first_not_of(" \t", digitEnd - line.c_str());
+        if (digitEnd == line.c_str() || key < 0 || key > 0xF || (*digitEnd != ' ' && *digitEnd != '\t') || nameBegin == std::string::npos){
+            if (error)
+                *error = std::string(path) + ":" + std::to_string(number) + ": expected a keypad digit 0-F and a key name";
+            return false;
+        }
+        std::string name = line.substr(nameBegin);
+        SDL_Scancode scancode = SDL_GetScancodeFromName(name.c_str());
+        if (scancode == SDL_SCANCODE_UNKNOWN){
+            if (error)
+                *error = std::string(path) + ":" + std::to_string(number) + ": no key is called \"" + name + "\"";
+            return false;
+        }
+        loaded[scancode] = static_cast<int8_t>(key);
+    }
+
+    std::copy(loaded, loaded + SDL_NUM_SCANCODES, table);
+    return true;
+}
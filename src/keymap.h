@@ -0,0 +1,34 @@
+#ifndef KEYMAP_HEADER
+#define KEYMAP_HEADER
+
+#include <SDL2/SDL.h>
+#include <cstdint>
+#include <string>
+
+// Which keypad key each host key stands for, one entry per scancode so a key press is a single lookup.
+// Scancodes name positions on the keyboard rather than letters, so the default layout is the same
+// block of keys (1234 QWER ASDF ZXCV) on any keyboard layout.
+// A file replaces the mapping, one key per line: the keypad digit in hex, then the SDL name of the
+// host key (as SDL_GetScancodeName() gives it). Blank lines and lines starting with # are skipped.
+// Several host keys may stand for one keypad key. Escape and backspace always quit and rewind
+class KeyMap {
+public:
+    static const int UNMAPPED = -1;
+
+    // The default layout
+    KeyMap();
+
+    // Replaces the mapping with the one in the file at path.
+    // False, with the reason in error when given, when it can't be read, the mapping is then unchanged
+    bool load(char const* path, std::string* error = nullptr);
+
+    // The keypad key scancode stands for, UNMAPPED for none
+    int lookup(SDL_Scancode scancode) const {
+        return scancode >= 0 && scancode < SDL_NUM_SCANCODES ? table[scancode] : UNMAPPED;
+    }
+
+private:
+    int8_t table[SDL_NUM_SCANCODES];
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "latency.h"
+
+#include <algorithm>
+
+// Enough for hours of play, percentiles come from these
+const size_t MAX_SAMPLES = 1u << 16u;
+// Key changes that never show up on screen (e.g. while rewinding) are given up on after this many
+const size_t MAX_PENDING = 256;
+
+static double milliseconds(InputLatency::clk::duration duration){
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+InputLatency::InputLatency(){
+    sequence = 0;
+    count = 0;
+    unseenCount = 0;
+    totalMilliseconds = 0;
+    totalWaitMilliseconds = 0;
+    maxMilliseconds = 0;
+}
+
+uint16_t InputLatency::keysChanged(clk::time_point when){
+    ++sequence;
+    if (pending.size() == MAX_PENDING)
+        pending.pop_front();
+    pending.push_back(Change{ sequence, when });
+    return sequence;
+}
+
+void InputLatency::presented(uint16_t sequence, clk::time_point sampled, clk::time_point when){
+    // Sequence numbers wrap, a change is covered when it is not after sequence
+    while (!pending.empty() && static_cast<int16_t>(sequence - pending.front().sequence) >= 0){
+        double latency = milliseconds(when - pending.front().when);
+        ++count;
+        totalMilliseconds += latency;
+        totalWaitMilliseconds += std::max(0.0, milliseconds(sampled - pending.front().when));
+        maxMilliseconds = std::max(maxMilliseconds, latency);
+        if (samples.size() < MAX_SAMPLES)
+            samples.push_back(static_cast<float>(latency));
+        pending.pop_front();
+    }
+}
+
+void InputLatency::unseen(uint16_t sequence){
+    while (!pending.empty() && static_cast<int16_t>(sequence - pending.front().sequence) >= 0){
+        ++unseenCount;
+        pending.pop_front();
+    }
+}
+
+unsigned long InputLatency::getCount() const {
+    return count;
+}
+
+unsigned long InputLatency::getUnseenCount() const {
+    return unseenCount;
+}
+
+double InputLatency::getMeanMilliseconds() const {
+    return count ? totalMilliseconds / count : 0;
+}
+
+double InputLatency::getMaxMilliseconds() const {
+    return maxMilliseconds;
+}
+
+double InputLatency::getPercentileMilliseconds(double fraction) const {
+    if (samples.empty())
+        return 0;
+    std::vector<float> sorted(samples);
+    size_t index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()));
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+double InputLatency::getMeanWaitMilliseconds() const {
+    return count ? totalWaitMilliseconds / count : 0;
+}
@@ -0,0 +1,58 @@
+#ifndef LATENCY_HEADER
+#define LATENCY_HEADER
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Measures input to photon latency: from the drawing thread handling a key change to it presenting
+// the first frame the emulation ran with that change, which is as soon as the player can see it.
+// Each key change gets a sequence number that travels with the keys to the emulation thread and
+// comes back on the frames it publishes. A change whose first frame shows nothing on screen has no
+// photon to time, it is counted apart rather than timed to whatever appears later.
+// Used from the drawing thread only
+class InputLatency {
+public:
+    typedef std::chrono::steady_clock clk;
+
+    InputLatency();
+
+    // The keys changed at when, returns the sequence number to hand the emulation thread with them
+    uint16_t keysChanged(clk::time_point when);
+    // A frame the emulation sampled at sampled, with the keys of sequence, was presented at when.
+    // Completes every key change up to sequence still waiting for one
+    void presented(uint16_t sequence, clk::time_point sampled, clk::time_point when);
+    // The first frame run with the keys of sequence changed nothing on screen.
+    // Drops every key change up to sequence still waiting, without a measurement
+    void unseen(uint16_t sequence);
+
+    // Key changes measured
+    unsigned long getCount() const;
+    // Key changes dropped because nothing on screen changed with them
+    unsigned long getUnseenCount() const;
+    // Over all measured key changes, in milliseconds
+    double getMeanMilliseconds() const;
+    double getMaxMilliseconds() const;
+    // The latency fraction of key changes (0 to 1) were shown within, in milliseconds
+    double getPercentileMilliseconds(double fraction) const;
+    // Mean part of it spent before the emulation sampled the keys, the rest is emulating and presenting
+    double getMeanWaitMilliseconds() const;
+
+private:
+    struct Change {
+        uint16_t sequence;
+        clk::time_point when;
+    };
+
+    uint16_t sequence;
+    std::deque<Change> pending; // oldest first
+    std::vector<float> samples; // milliseconds, the first MAX_SAMPLES of them
+    unsigned long count;
+    unsigned long unseenCount;
+    double totalMilliseconds;
+    double totalWaitMilliseconds;
+    double maxMilliseconds;
+};
+
+#endif
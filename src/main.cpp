@@ -1,59 +1,263 @@
+#include "beeper.h"
 #include "chip8.h"
+#include "emulation.h"
 #include "engine.h"
+#include "hash.h"
+#include "keymap.h"
+#include "latency.h"
+#include "movie.h"
+#include "profiler.h"
+#include "rewind.h"
+#include "romstore.h"
+#include "scheduler.h"
+#include "video.h"
 
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Parses a colour given as RRGGBB or RRGGBBAA
+static bool parseColour(char const* text, uint32_t& colour){
+    size_t length = std::strlen(text);
+    if (length != 6 && length != 8)
+        return false;
+    char* end = nullptr;
+    unsigned long value = std::strtoul(text, &end, 16);
+    if (*end != '\0')
+        return false;
+    colour = length == 6 ? (static_cast<uint32_t>(value) << 8u) | 0xFFu : static_cast<uint32_t>(value);
+    return true;
+}
+
+// Longest the drawing thread sleeps waiting for input or a frame, before looking again anyway
+const int IDLE_WAIT_MS = 250;
 
 int main (int argc, char* argv[]){
 
     // Scale video ratio. CHIP-8 is very small (64x32)
     int videoScaler = 10; // for now
-    // Slow down the clock rate
-    int delay = 3; // for now
+    // Emulated clock rate, 0 runs as many instructions as each frame allows
+    int instructionsPerSecond = 600; // for now
     // Rom
-    char* path = "roms/tetris.ch8";
+    char const* path = "roms/tetris.ch8";
+    // Options
+    Palette palette = DEFAULT_PALETTE;
+    bool softwareRenderer = false;
+    ExecutionMode mode = INTERPRETER;
+    unsigned int rewindSeconds = 30; // 0 turns rewind off
+    unsigned int rewindMegabytes = 16;
+    unsigned int audioBufferSamples = Beeper::DEFAULT_BUFFER_SAMPLES; // 0 mutes
+    bool seeded = false;
+    uint64_t seed = 0;
+    char const* recordPath = nullptr;
+    RandomGenerator generator = STANDARD_GENERATOR;
+    QuirkProfile quirks = DEFAULT_QUIRKS;
+    char const* profilePath = nullptr;
+    char const* keymapPath = nullptr;
+    
+    // Options come first, as --name [value]
+    std::vector<char*> args;
+    for (int i = 1; i < argc; ++i){
+        if (std::strcmp(argv[i], "--fg") == 0 && i + 1 < argc && parseColour(argv[i + 1], palette.on))
+            ++i;
+        else if (std::strcmp(argv[i], "--bg") == 0 && i + 1 < argc && parseColour(argv[i + 1], palette.off))
+            ++i;
+        else if (std::strcmp(argv[i], "--software") == 0)
+            softwareRenderer = true;
+        else if (std::strcmp(argv[i], "--recompile") == 0)
+            mode = RECOMPILER;
+        else if (std::strcmp(argv[i], "--rewind-seconds") == 0 && i + 1 < argc)
+            rewindSeconds = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--rewind-mb") == 0 && i + 1 < argc)
+            rewindMegabytes = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc)
+            audioBufferSamples = std::strtoul(argv[++i], nullptr, 10);
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc){
+            seed = std::strtoull(argv[++i], nullptr, 10);
+            seeded = true;
+        }
+        else if (std::strcmp(argv[i], "--random") == 0 && i + 1 < argc && std::strcmp(argv[i + 1], "standard") == 0){
+            generator = STANDARD_GENERATOR;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--random") == 0 && i + 1 < argc && std::strcmp(argv[i + 1], "xorshift") == 0){
+            generator = XORSHIFT_GENERATOR;
+            ++i;
+        }
+        else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc && Chip8::findQuirkProfile(argv[i + 1], &quirks))
+            ++i;
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (std::strcmp(argv[i], "--keymap") == 0 && i + 1 < argc)
+            keymapPath = argv[++i];
+        else
+            args.push_back(argv[i]);
+    }
     
-    if (argc == 2){ // prgName [Rom]
-        path = argv[1];
+    if (args.size() == 1){ // prgName [Rom]
+        path = args[0];
     }
-    else if (argc == 4){ // prgName [videoScaler] [delay] [Rom]
-        videoScaler = std::stoi(argv[1]);
-        delay = std::stoi(argv[2]);
-        path = argv[4];
+    else if (args.size() == 3){ // prgName [videoScaler] [instructionsPerSecond] [Rom]
+        videoScaler = std::stoi(args[0]);
+        instructionsPerSecond = std::stoi(args[1]);
+        path = args[2];
     }
     else {
         std::cerr << "NOTE!!!" << std::endl;
-        std::cerr << " - Arguments where not properly provided. Using defaule of 10 3 \"rom/tetris.ch8\"" << std::endl;
+        std::cerr << " - Arguments where not properly provided. Using defaule of 10 600 \"rom/tetris.ch8\"" << std::endl;
+    }
+    
+    // Checked before a window opens
+    std::string error;
+    std::shared_ptr<RomImage const> rom = RomStore::shared().open(path, &error);
+    if (!rom){
+        std::cerr << "Could not load rom: " << error << std::endl;
+        return 1;
+    }
+    KeyMap keymap;
+    if (keymapPath && !keymap.load(keymapPath, &error)){
+        std::cerr << "Could not load key map: " << error << std::endl;
+        return 1;
     }
     
+    // The software renderer gets pixels already scaled up, as it would scale slowly itself
+    int textureScaler = softwareRenderer ? videoScaler : 1;
+    int textureWidth = VIDEO_WIDTH * textureScaler;
+    
     Engine engine("CHIP-8 Emulator",
                     VIDEO_WIDTH * videoScaler,
                     VIDEO_HEIGHT * videoScaler, /*window*/
-                    VIDEO_WIDTH, VIDEO_HEIGHT /*texture*/);
+                    textureWidth, VIDEO_HEIGHT * textureScaler, /*texture*/
+                    softwareRenderer);
+    engine.setKeyMap(keymap);
     
     
-    Chip8 device(path);
+    Chip8 device(*rom);
+    device.setQuirkProfile(quirks);
+    device.setRandomGenerator(generator);
+    Scheduler scheduler(device, instructionsPerSecond, mode);
+
+    // An input movie replays exactly only when the seed and every frame's budget are known
+    std::ofstream movie;
+    std::unique_ptr<MovieRecorder> recorder;
+    if (recordPath && instructionsPerSecond == 0)
+        std::cerr << "Not recording, a movie needs a fixed instructions per second" << std::endl;
+    else if (recordPath){
+        movie.open(recordPath, std::ios::binary);
+        if (!seeded)
+            seed = std::chrono::system_clock::now().time_since_epoch().count();
+        seeded = true;
+        recorder.reset(new MovieRecorder(movie, generator, quirks, seed, instructionsPerSecond));
+        rewindSeconds = 0; // going back in time would break the recording
+    }
+    if (seeded)
+        device.seedRandom(seed);
+    // Counts what the interpreter runs until the window closes
+#if defined(CHIP8_PROFILE)
+    Profiler profiler;
+    if (profilePath && mode == RECOMPILER)
+        std::cerr << "Not profiling, recompiled blocks don't go through the interpreter" << std::endl;
+    else if (profilePath)
+        device.setProfiler(&profiler);
+#else
+    if (profilePath)
+        std::cerr << "Not profiling, build with make app PROFILE=1 first" << std::endl;
+#endif
+    // Holding backspace plays the recorded frames backwards
+    RewindBuffer rewind(device, rewindSeconds, size_t(rewindMegabytes) << 20u);
     
-    int scanLineInBytes = sizeof(device.displayMemory[0]) * VIDEO_WIDTH;
+    // The display is packed one bit per pixel, it is expanded here only when presenting
+    std::vector<uint32_t> pixels(textureWidth * VIDEO_HEIGHT * textureScaler);
+    int scanLineInBytes = sizeof(pixels[0]) * textureWidth;
     
-    typedef std::chrono::high_resolution_clock clk;
-    auto lastTime = clk::now();
+    // The buzzer, fed by the emulation thread
+    std::unique_ptr<Beeper> beeper;
+    if (audioBufferSamples > 0){
+        beeper.reset(new Beeper(audioBufferSamples));
+        if (!beeper->isOpen())
+            std::cerr << "No sound, the audio device could not be opened: " << SDL_GetError() << std::endl;
+    }
+    std::function<void(unsigned long long, bool)> onSound;
+    if (beeper && beeper->isOpen())
+        onSound = [&beeper](unsigned long long frame, bool on){ beeper->setTone(frame, on); };
+
+    // Emulation runs on its own thread from here on, this one only handles events and draws
+    EmulationThread emulation(device, scheduler, rewindSeconds > 0 ? &rewind : nullptr, recorder.get(),
+                              [&engine]{ engine.wake(); }, onSound);
+    uint8_t keys[sizeof(device.keypad)] = {};
+    // Times each key change until the first frame run with it is on screen
+    InputLatency latency;
+    uint16_t inputSequence = 0;
+    uint64_t shown[VIDEO_HEIGHT] = {}; // what the texture holds
+    bool textureValid = false;
     while (engine.getQuitFlag() != true){
-        engine.processInput(device.keypad);
-        auto current = clk::now();
-        float elapsed = std::chrono::duration<float, std::chrono::milliseconds::period>(current - lastTime).count();
-        
-        if (elapsed > delay){
-            lastTime = current;
-            device.cycle();
-            engine.update(device.displayMemory, scanLineInBytes);
-            
+        // Sleeps until input arrives or the emulation thread has a new frame
+        uint8_t held[sizeof(keys)];
+        std::memcpy(held, keys, sizeof(keys));
+        engine.waitForInput(keys, IDLE_WAIT_MS);
+        if (std::memcmp(held, keys, sizeof(keys)) != 0)
+            inputSequence = latency.keysChanged(InputLatency::clk::now());
+        emulation.setKeys(keys, inputSequence);
+        emulation.setRewinding(engine.isRewinding());
+
+        // Read before taking a frame, so any frame published ahead of the unseen sequence is taken first
+        uint16_t unseen = emulation.getUnseenSequence();
+        DisplayFrame const* frame = emulation.takeFrame();
+        unsigned int first = 0;
+        unsigned int end = 0;
+        if (frame && !textureValid)
+            end = VIDEO_HEIGHT;
+        else if (frame){
+            // Frames may have been skipped since the last one drawn, so changes are found against what the texture holds
+            for (unsigned int row = 0; row < VIDEO_HEIGHT; ++row){
+                if (frame->displayMemory[row] != shown[row]){
+                    if (end == 0)
+                        first = row;
+                    end = row + 1;
+                }
+            }
         }
-        else
-            std::this_thread::sleep_for (std::chrono::nanoseconds(20));
-        
+        if (first < end){
+            // Upload only the rows that changed
+            unsigned int count = end - first;
+            uint32_t* firstPixel = &pixels[first * textureScaler * textureWidth];
+            expandRows(&frame->displayMemory[first], count, VIDEO_WIDTH, firstPixel, palette, textureScaler);
+            engine.update(firstPixel, scanLineInBytes, first * textureScaler, count * textureScaler);
+            std::memcpy(shown, frame->displayMemory, sizeof(shown));
+            textureValid = true;
+            latency.presented(frame->inputSequence, frame->sampled, InputLatency::clk::now());
+        }
+        else {
+            // A frame back to what the texture already holds shows nothing new either
+            if (frame)
+                latency.unseen(frame->inputSequence);
+            if (engine.needsRedraw())
+                engine.present();
+        }
+        latency.unseen(unseen);
     }
+    emulation.stop();
+
+    if (recorder)
+        recorder->finish(scheduler.getCycles(), fnv1a(device.displayMemory, sizeof(device.displayMemory)));
+#if defined(CHIP8_PROFILE)
+    if (profilePath && mode != RECOMPILER && !profiler.write(device, profilePath))
+        std::cerr << "Could not write a profile to \"" << profilePath << "\"" << std::endl;
+#endif
+    FramePacer const& pacer = emulation.getPacer();
+    std::cout << "Paced at " << pacer.getAchievedHz() << " Hz, woke " << pacer.getMeanLatenessMicroseconds() << " us late on average, jitter "
+              << pacer.getJitterMicroseconds() << " us, " << pacer.getDroppedFrames() << " dropped frames" << std::endl;
+    if (latency.getCount() > 0)
+        std::cout << "Input to photon over " << latency.getCount() << " key changes: mean "
+                  << latency.getMeanMilliseconds() << " ms (" << latency.getMeanWaitMilliseconds() << " ms of it waiting for a frame), 95th percentile "
+                  << latency.getPercentileMilliseconds(0.95) << " ms, max " << latency.getMaxMilliseconds() << " ms, "
+                  << latency.getUnseenCount() << " more changed nothing on screen" << std::endl;
     return 0;
 }
-
-
@@ -0,0 +1,178 @@
+#include "movie.h"
+
+#include <algorithm>
+
+// Format: magic, version, random generator (1 byte), quirk profile (1 byte), seed (8 bytes), instructions per second (4 bytes), all little endian.
+// Then records, each a tag byte and the cycles since the previous record as a varint:
+// KEYS_RECORD is followed by the 16 keys as a 2 byte mask, END_RECORD by the 8 byte display hash
+const char MOVIE_MAGIC[4] = { 'C', '8', 'M', 'V' };
+const uint8_t MOVIE_VERSION = 3;
+const uint8_t KEYS_RECORD = 'K';
+const uint8_t END_RECORD = 'E';
+
+namespace {
+
+void putBytes(std::ostream& out, uint64_t value, unsigned int count){
+    for (unsigned int i = 0; i < count; ++i)
+        out.put(static_cast<char>((value >> (8u * i)) & 0xFFu));
+}
+
+uint64_t getBytes(std::istream& in, unsigned int count){
+    uint64_t value = 0;
+    for (unsigned int i = 0; i < count; ++i)
+        value |= uint64_t(static_cast<uint8_t>(in.get())) << (8u * i);
+    return value;
+}
+
+void putVarint(std::ostream& out, unsigned long long value){
+    while (value >= 0x80u){
+        out.put(static_cast<char>((value & 0x7Fu) | 0x80u));
+        value >>= 7u;
+    }
+    out.put(static_cast<char>(value));
+}
+
+unsigned long long getVarint(std::istream& in){
+    unsigned long long value = 0;
+    for (unsigned int shift = 0; shift < 64 && in; shift += 7){
+        uint8_t byte = static_cast<uint8_t>(in.get());
+        value |= (unsigned long long)(byte & 0x7Fu) << shift;
+        if (!(byte & 0x80u))
+            break;
+    }
+    return value;
+}
+
+uint16_t packKeys(uint8_t const* keypad){
+    uint16_t keys = 0;
+    for (unsigned int key = 0; key < 16; ++key)
+        keys |= (keypad[key] ? 1u : 0u) << key;
+    return keys;
+}
+
+}
+
+MovieRecorder::MovieRecorder(std::ostream& out, RandomGenerator generator, QuirkProfile quirks, uint64_t seed, unsigned int instructionsPerSecond) : out(out) {
+    keys = 0;
+    lastCycle = 0;
+    finished = false;
+
+    out.write(MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+    out.put(static_cast<char>(MOVIE_VERSION));
+    out.put(static_cast<char>(generator));
+    out.put(static_cast<char>(quirks));
+    putBytes(out, seed, 8);
+    putBytes(out, instructionsPerSecond, 4);
+}
+
+void MovieRecorder::record(unsigned long long cycle, uint8_t const* keypad){
+    uint16_t pressed = packKeys(keypad);
+    if (finished || pressed == keys)
+        return;
+    out.put(static_cast<char>(KEYS_RECORD));
+    putVarint(out, cycle - lastCycle);
+    putBytes(out, pressed, 2);
+    keys = pressed;
+    lastCycle = cycle;
+}
+
+void MovieRecorder::finish(unsigned long long cycle, uint64_t displayHash){
+    if (finished)
+        return;
+    out.put(static_cast<char>(END_RECORD));
+    putVarint(out, cycle - lastCycle);
+    putBytes(out, displayHash, 8);
+    out.flush();
+    finished = true;
+}
+
+MoviePlayer::MoviePlayer(std::istream& in) : in(in) {
+    generator = STANDARD_GENERATOR;
+    quirks = DEFAULT_QUIRKS;
+    seed = 0;
+    instructionsPerSecond = 0;
+    finished = false;
+    nextCycle = 0;
+    nextKeys = 0;
+    endCycle = 0;
+    displayHash = 0;
+
+    char magic[sizeof(MOVIE_MAGIC)] = {};
+    in.read(magic, sizeof(magic));
+    valid = in && std::equal(magic, magic + sizeof(magic), MOVIE_MAGIC) && in.get() == MOVIE_VERSION;
+    if (!valid)
+        return;
+    int kind = in.get();
+    valid = kind == STANDARD_GENERATOR || kind == XORSHIFT_GENERATOR;
+    if (!valid)
+        return;
+    generator = static_cast<RandomGenerator>(kind);
+    int profile = in.get();
+    valid = profile >= 0 && profile < QUIRK_PROFILES;
+    if (!valid)
+        return;
+    quirks = static_cast<QuirkProfile>(profile);
+    seed = getBytes(in, 8);
+    instructionsPerSecond = getBytes(in, 4);
+    readNext();
+}
+
+bool MoviePlayer::isValid() const {
+    return valid;
+}
+
+RandomGenerator MoviePlayer::getRandomGenerator() const {
+    return generator;
+}
+
+QuirkProfile MoviePlayer::getQuirkProfile() const {
+    return quirks;
+}
+
+uint64_t MoviePlayer::getSeed() const {
+    return seed;
+}
+
+unsigned int MoviePlayer::getInstructionsPerSecond() const {
+    return instructionsPerSecond;
+}
+
+bool MoviePlayer::isFinished() const {
+    return finished;
+}
+
+unsigned long long MoviePlayer::getEndCycle() const {
+    return endCycle;
+}
+
+uint64_t MoviePlayer::getDisplayHash() const {
+    return displayHash;
+}
+
+void MoviePlayer::readNext(){
+    int tag = in.get();
+    unsigned long long cycle = nextCycle + getVarint(in);
+    if (tag == KEYS_RECORD){
+        nextCycle = cycle;
+        nextKeys = getBytes(in, 2);
+        if (in)
+            return;
+    }
+    else if (tag == END_RECORD){
+        endCycle = cycle;
+        displayHash = getBytes(in, 8);
+    }
+    // The end record, or a movie cut short
+    finished = true;
+    if (!in)
+        endCycle = nextCycle;
+}
+
+void MoviePlayer::apply(unsigned long long cycle, uint8_t* keypad){
+    // Changes land on the first frame boundary at or after their cycle
+    while (valid && !finished && nextCycle <= cycle){
+        for (unsigned int key = 0; key < 16; ++key)
+            keypad[key] = (nextKeys >> key) & 1u;
+        readNext();
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef MOVIE_HEADER
+#define MOVIE_HEADER
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#include "chip8.h"
+
+// An input movie: the random generator, quirk profile, seed and instruction rate a run started with,
+// then every change of the keypad keyed by the number of instructions executed before it (see Scheduler::getCycles()).
+// Replaying it against the same rom reproduces the run exactly, and it ends with a hash of the final display to check that
+class MovieRecorder {
+public:
+    // Writes the header straight away, events are streamed as they happen
+    MovieRecorder(std::ostream& out, RandomGenerator generator, QuirkProfile quirks, uint64_t seed, unsigned int instructionsPerSecond);
+
+    // Call before each frame with the keys about to be used, only changes are written
+    void record(unsigned long long cycle, uint8_t const* keypad);
+    // Ends the movie with the state the run finished in
+    void finish(unsigned long long cycle, uint64_t displayHash);
+
+private:
+    std::ostream& out;
+    uint16_t keys; // last keys written
+    unsigned long long lastCycle;
+    bool finished;
+};
+
+class MoviePlayer {
+public:
+    // Reads the header, events are read as they fall due
+    MoviePlayer(std::istream& in);
+
+    // False when the stream doesn't start with a movie header
+    bool isValid() const;
+    RandomGenerator getRandomGenerator() const;
+    QuirkProfile getQuirkProfile() const;
+    uint64_t getSeed() const;
+    unsigned int getInstructionsPerSecond() const;
+
+    // Applies every change recorded up to this cycle, call before each frame
+    void apply(unsigned long long cycle, uint8_t* keypad);
+    // True once the end of the movie was reached, getEndCycle() and getDisplayHash() are then known
+    bool isFinished() const;
+    unsigned long long getEndCycle() const;
+    uint64_t getDisplayHash() const;
+
+private:
+    // Reads the next event, or the end
+    void readNext();
+
+    std::istream& in;
+    bool valid;
+    RandomGenerator generator;
+    QuirkProfile quirks;
+    uint64_t seed;
+    unsigned int instructionsPerSecond;
+
+    bool finished;
+    unsigned long long nextCycle; // cycle of the event read ahead
+    uint16_t nextKeys;
+    unsigned long long endCycle;
+    uint64_t displayHash;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#include "pacer.h"
+
+#include <cmath>
+#include <thread>
+
+// Bounds for the spin margin
+const std::chrono::microseconds MIN_SPIN_MARGIN(100);
+const std::chrono::microseconds MAX_SPIN_MARGIN(4000);
+
+FramePacer::FramePacer(clk::duration period) : period(period), spinMargin(std::chrono::microseconds(1000)) {
+    overshootMicroseconds = 500;
+    meanLatenessMicroseconds = 0;
+    jitterMicroseconds = 0;
+    achievedHz = 0;
+    droppedFrames = 0;
+    resync();
+}
+
+void FramePacer::resync(){
+    deadline = clk::now();
+    windowStart = deadline;
+    windowFrames = 0;
+    windowErrorMicroseconds = 0;
+    windowSquaredErrorMicroseconds = 0;
+}
+
+void FramePacer::wait(){
+    clk::time_point now = clk::now();
+
+    if (now < deadline){
+        // Coarse sleep, which may overshoot by the scheduler's granularity
+        clk::time_point sleepTarget = deadline - spinMargin;
+        if (now < sleepTarget){
+            std::this_thread::sleep_until(sleepTarget);
+            now = clk::now();
+
+            // Keep the margin at about twice the typical overshoot, averaged so a single outlier doesn't inflate it
+            double overshoot = std::chrono::duration<double, std::micro>(now - sleepTarget).count();
+            overshootMicroseconds += (overshoot - overshootMicroseconds) / 8;
+            spinMargin = std::chrono::duration_cast<clk::duration>(std::chrono::duration<double, std::micro>(2 * overshootMicroseconds));
+
+            if (spinMargin < MIN_SPIN_MARGIN)
+                spinMargin = MIN_SPIN_MARGIN;
+            else if (spinMargin > MAX_SPIN_MARGIN)
+                spinMargin = MAX_SPIN_MARGIN;
+        }
+        // Short spin for the remainder
+        while (now < deadline){
+            std::this_thread::yield();
+            now = clk::now();
+        }
+    }
+
+    double error = std::chrono::duration<double, std::micro>(now - deadline).count();
+    windowErrorMicroseconds += error;
+    windowSquaredErrorMicroseconds += error * error;
+    ++windowFrames;
+
+    // Fell more than a whole frame behind, skip the missed frames rather than bursting to catch up
+    if (now - deadline > period){
+        droppedFrames += (now - deadline) / period;
+        deadline = now;
+    }
+    deadline += period;
+
+    double windowSeconds = std::chrono::duration<double>(now - windowStart).count();
+    if (windowSeconds >= 1.0){
+        meanLatenessMicroseconds = windowErrorMicroseconds / windowFrames;
+        // Rounding may take the variance a hair below zero when every wake up was equally late
+        double variance = windowSquaredErrorMicroseconds / windowFrames - meanLatenessMicroseconds * meanLatenessMicroseconds;
+        jitterMicroseconds = variance > 0 ? std::sqrt(variance) : 0;
+        achievedHz = windowFrames / windowSeconds;
+        windowStart = now;
+        windowFrames = 0;
+        windowErrorMicroseconds = 0;
+        windowSquaredErrorMicroseconds = 0;
+    }
+}
+
+FramePacer::clk::time_point FramePacer::getDeadline() const {
+    return deadline;
+}
+
+double FramePacer::getMeanLatenessMicroseconds() const {
+    return meanLatenessMicroseconds;
+}
+
+double FramePacer::getJitterMicroseconds() const {
+    return jitterMicroseconds;
+}
+
+double FramePacer::getAchievedHz() const {
+    return achievedHz;
+}
+
+unsigned long FramePacer::getDroppedFrames() const {
+    return droppedFrames;
+}
@@ -0,0 +1,49 @@
+#ifndef PACER_HEADER
+#define PACER_HEADER
+
+#include <chrono>
+
+// Paces a loop to a fixed frame rate without pinning a core.
+// wait() sleeps until shortly before the next deadline and spins only for the remainder.
+// Deadlines advance by exactly one period so errors don't accumulate into drift.
+class FramePacer {
+public:
+    typedef std::chrono::steady_clock clk;
+
+    FramePacer(clk::duration period);
+
+    // Blocks until the start of the next frame
+    void wait();
+    // Forget the schedule and start counting frames from now, e.g. after the loop was blocked
+    void resync();
+
+    // End of the frame that wait() last returned for
+    clk::time_point getDeadline() const;
+    // Mean distance between the deadlines and the actual wake ups, over the last second
+    double getMeanLatenessMicroseconds() const;
+    // Standard deviation of that distance over the last second, how much the wake ups wander
+    double getJitterMicroseconds() const;
+    // Frames per second actually achieved, over the last second
+    double getAchievedHz() const;
+    // Frames skipped because the loop fell more than a whole period behind
+    unsigned long getDroppedFrames() const;
+
+private:
+    clk::duration period;
+    clk::time_point deadline;
+    // How long before a deadline to stop sleeping and start spinning, adapts to the host's sleep accuracy
+    clk::duration spinMargin;
+    double overshootMicroseconds; // running average of how late sleep_until wakes up
+
+    // Statistics window
+    clk::time_point windowStart;
+    unsigned long windowFrames;
+    double windowErrorMicroseconds;
+    double windowSquaredErrorMicroseconds; // sum of squares, for the standard deviation
+    double meanLatenessMicroseconds;
+    double jitterMicroseconds;
+    double achievedHz;
+    unsigned long droppedFrames;
+};
+
+#endif
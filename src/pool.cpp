@@ -0,0 +1,180 @@
+#include "pool.h"
+#include "romstore.h"
+
+#include <algorithm>
+#include <climits>
+#include <chrono>
+
+// Instances per chunk of work, small enough to balance, large enough to keep stealing rare
+const size_t CHUNK_SIZE = 16;
+
+EmulatorPool::Instance::Instance(Chip8 const& prototype, unsigned int instructionsPerSecond, ExecutionMode mode)
+    : device(prototype), scheduler(device, instructionsPerSecond, mode), stats() {
+}
+
+EmulatorPool::EmulatorPool(unsigned int threads, unsigned int instructionsPerSecond, ExecutionMode mode)
+    : instructionsPerSecond(instructionsPerSecond), mode(mode), instructionBudget(0), generation(0), stopping(false), remaining(0) {
+    totalInstructions = 0;
+    totalSeconds = 0;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int i = 0; i < threads; ++i)
+        workers.emplace_back(new Worker());
+    for (unsigned int i = 0; i < threads; ++i)
+        workers[i]->thread = std::thread(&EmulatorPool::workerLoop, this, i);
+}
+
+EmulatorPool::~EmulatorPool(){
+    {
+        std::lock_guard<std::mutex> guard(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::unique_ptr<Worker>& worker : workers)
+        worker->thread.join();
+}
+
+size_t EmulatorPool::add(char const* romPath){
+    // The file is read once however many machines load it, one that can't be loaded leaves memory empty as Chip8(romPath) does
+    std::shared_ptr<RomImage const> rom = RomStore::shared().open(romPath);
+    return rom ? add(Chip8(*rom)) : add(Chip8());
+}
+
+size_t EmulatorPool::add(Chip8 const& prototype){
+    instances.emplace_back(new Instance(prototype, instructionsPerSecond, mode));
+    return instances.size() - 1;
+}
+
+size_t EmulatorPool::size() const {
+    return instances.size();
+}
+
+unsigned int EmulatorPool::getThreadCount() const {
+    return workers.size();
+}
+
+Chip8& EmulatorPool::getInstance(size_t id){
+    return instances[id]->device;
+}
+
+EmulatorPool::InstanceStats const& EmulatorPool::getStats(size_t id) const {
+    return instances[id]->stats;
+}
+
+unsigned long long EmulatorPool::getTotalInstructions() const {
+    return totalInstructions;
+}
+
+double EmulatorPool::getInstructionsPerSecond() const {
+    return totalSeconds > 0 ? totalInstructions / totalSeconds : 0.0;
+}
+
+void EmulatorPool::setInstructionBudget(unsigned long long instructions){
+    instructionBudget = instructions;
+}
+
+bool EmulatorPool::isRunning(size_t id) const {
+    return isRunning(*instances[id]);
+}
+
+bool EmulatorPool::isRunning(Instance const& instance) const {
+    return !instance.stats.halted && (instructionBudget == 0 || instance.stats.instructions < instructionBudget);
+}
+
+void EmulatorPool::tick(unsigned int frames){
+    if (instances.empty() || frames == 0)
+        return;
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Deal the chunks out round robin. The count is published first,
+    // as a worker still finishing the last tick may pick a chunk up straight away
+    size_t chunks = (instances.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    remaining = chunks;
+    for (size_t i = 0; i < chunks; ++i){
+        Chunk chunk;
+        chunk.begin = i * CHUNK_SIZE;
+        chunk.end = std::min(chunk.begin + CHUNK_SIZE, instances.size());
+        chunk.frames = frames;
+
+        Worker& worker = *workers[i % workers.size()];
+        std::lock_guard<std::mutex> guard(worker.lock);
+        worker.tasks.push_back(chunk);
+    }
+
+    std::unique_lock<std::mutex> lock(stateLock);
+    ++generation;
+    wake.notify_all();
+    done.wait(lock, [this]{ return remaining == 0; });
+    lock.unlock();
+
+    totalSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    totalInstructions = 0;
+    for (std::unique_ptr<Instance> const& instance : instances)
+        totalInstructions += instance->stats.instructions;
+}
+
+void EmulatorPool::workerLoop(unsigned int index){
+    unsigned long seen = 0;
+    while (true){
+        {
+            std::unique_lock<std::mutex> lock(stateLock);
+            wake.wait(lock, [&]{ return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        Chunk chunk;
+        while (take(index, chunk)){
+            run(chunk);
+            if (--remaining == 0){
+                // Lock so the notification can't slip in between tick()'s check and its wait
+                std::lock_guard<std::mutex> guard(stateLock);
+                done.notify_all();
+            }
+        }
+    }
+}
+
+bool EmulatorPool::take(unsigned int index, Chunk& chunk){
+    {
+        // Own work comes off the back
+        Worker& own = *workers[index];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if (!own.tasks.empty()){
+            chunk = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    // Stolen work comes off the front, away from where the owner is working
+    for (size_t i = 1; i < workers.size(); ++i){
+        Worker& victim = *workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (!victim.tasks.empty()){
+            chunk = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void EmulatorPool::run(Chunk const& chunk){
+    for (size_t i = chunk.begin; i < chunk.end; ++i){
+        Instance& instance = *instances[i];
+        // Machines that halted or used up their budget take no more time, not even part of a tick
+        for (unsigned int frame = 0; frame < chunk.frames && isRunning(instance); ++frame){
+            // The last frame of a budget stops where it runs out
+            unsigned long long left = instructionBudget - instance.stats.instructions;
+            unsigned long limit = instructionBudget == 0 || left > ULONG_MAX ? ULONG_MAX : left;
+            instance.stats.instructions += instance.scheduler.runFrame(limit);
+            ++instance.stats.frames;
+            if (instance.device.isIdle())
+                ++instance.stats.idleFrames;
+            instance.stats.halted = instance.device.isHalted();
+        }
+    }
+}
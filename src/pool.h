@@ -0,0 +1,96 @@
+#ifndef POOL_HEADER
+#define POOL_HEADER
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "chip8.h"
+#include "scheduler.h"
+
+// Runs many Chip8 machines at once over a pool of worker threads.
+// Each tick splits the machines into small chunks spread over the workers' queues,
+// a worker that empties its own queue steals chunks from the others.
+class EmulatorPool {
+public:
+    struct InstanceStats {
+        unsigned long long instructions; // executed so far
+        unsigned long long frames; // run so far
+        unsigned long long idleFrames; // frames that ended idle (see Chip8::isIdle)
+        bool halted; // the program can't progress on its own (see Chip8::isHalted)
+    };
+
+    // threads = 0 uses one per hardware thread
+    EmulatorPool(unsigned int threads = 0, unsigned int instructionsPerSecond = 600, ExecutionMode mode = INTERPRETER);
+    ~EmulatorPool();
+
+    // Adds a machine and returns its id, ids count up from 0
+    size_t add(char const* romPath);
+    size_t add(Chip8 const& prototype);
+
+    // Stops each machine once it executed exactly this many instructions, its last frame is cut short. 0, the default, never does
+    void setInstructionBudget(unsigned long long instructions);
+    // Runs `frames` frames of emulated time on every machine still running, returns once all are done
+    void tick(unsigned int frames = 1);
+    // False once the machine halted or used up its budget, ticks then leave it alone
+    bool isRunning(size_t id) const;
+
+    size_t size() const;
+    unsigned int getThreadCount() const;
+    Chip8& getInstance(size_t id);
+    InstanceStats const& getStats(size_t id) const;
+
+    // Totals over every tick so far
+    unsigned long long getTotalInstructions() const;
+    double getInstructionsPerSecond() const;
+
+private:
+    struct Instance {
+        Chip8 device;
+        Scheduler scheduler;
+        InstanceStats stats;
+
+        Instance(Chip8 const& prototype, unsigned int instructionsPerSecond, ExecutionMode mode);
+    };
+
+    // A run of consecutive instances to step by some frames
+    struct Chunk {
+        size_t begin;
+        size_t end;
+        unsigned int frames;
+    };
+
+    struct Worker {
+        std::mutex lock; // guards tasks
+        std::deque<Chunk> tasks;
+        std::thread thread;
+    };
+
+    void workerLoop(unsigned int index);
+    // Pops from the worker's own queue, or steals from another one
+    bool take(unsigned int index, Chunk& chunk);
+    void run(Chunk const& chunk);
+    bool isRunning(Instance const& instance) const;
+
+    unsigned int instructionsPerSecond;
+    ExecutionMode mode;
+    unsigned long long instructionBudget; // per machine, 0 for none
+    std::vector<std::unique_ptr<Instance>> instances;
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::mutex stateLock; // guards generation and stopping
+    std::condition_variable wake; // a new tick was queued
+    std::condition_variable done; // the last chunk of a tick finished
+    unsigned long generation;
+    bool stopping;
+    std::atomic<size_t> remaining; // chunks of the current tick not yet finished
+
+    unsigned long long totalInstructions;
+    double totalSeconds;
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+// Clock reads timed back to back to estimate what timing itself costs
+const unsigned int CLOCK_CALIBRATION_READS = 1000;
+
+Profiler::Profiler() : opcodes(0xFFFF + 1), addresses(0xFFF + 1), samples(0xFFFF + 1), sampledNanoseconds(0xFFFF + 1) {
+    untilSample = SAMPLE_INTERVAL;
+
+    // The cheapest pair of reads is what every sample pays on top of the handler
+    clockOverhead = 0.0;
+    for (unsigned int i = 0; i < CLOCK_CALIBRATION_READS; ++i){
+        clk::time_point start = clk::now();
+        double elapsed = std::chrono::duration<double, std::nano>(clk::now() - start).count();
+        if (i == 0 || elapsed < clockOverhead)
+            clockOverhead = elapsed;
+    }
+}
+
+void Profiler::addSample(uint16_t opcode, clk::time_point start, clk::time_point end){
+    double elapsed = std::chrono::duration<double, std::nano>(end - start).count() - clockOverhead;
+    ++samples[opcode];
+    sampledNanoseconds[opcode] += std::max(elapsed, 0.0);
+}
+
+unsigned long long Profiler::getInstructions() const {
+    unsigned long long total = 0;
+    for (unsigned long long count : opcodes)
+        total += count;
+    return total;
+}
+
+char const* Profiler::handlerName(uint16_t opcode){
+    static const struct {
+        Chip8::opcodeTableFnPtr function;
+        char const* name;
+    } handlers[] = {
+        { &Chip8::OP_00E0_CLS, "OP_00E0_CLS" }, { &Chip8::OP_00EE_RET, "OP_00EE_RET" },
+        { &Chip8::OP_1nnn_JP, "OP_1nnn_JP" }, { &Chip8::OP_2nnn_CALL, "OP_2nnn_CALL" },
+        { &Chip8::OP_3xkk_SE, "OP_3xkk_SE" }, { &Chip8::OP_4xkk_SNE, "OP_4xkk_SNE" },
+        { &Chip8::OP_5xy0_SE, "OP_5xy0_SE" }, { &Chip8::OP_6xkk_LD, "OP_6xkk_LD" },
+        { &Chip8::OP_7xkk_ADD, "OP_7xkk_ADD" }, { &Chip8::OP_8xy0_LD, "OP_8xy0_LD" },
+        { &Chip8::OP_8xy1_OR<false>, "OP_8xy1_OR" }, { &Chip8::OP_8xy2_AND<false>, "OP_8xy2_AND" },
+        { &Chip8::OP_8xy3_XOR<false>, "OP_8xy3_XOR" }, { &Chip8::OP_8xy4_ADD, "OP_8xy4_ADD" },
+        { &Chip8::OP_8xy5_SUB, "OP_8xy5_SUB" }, { &Chip8::OP_8xy6_SHR<false>, "OP_8xy6_SHR" },
+        { &Chip8::OP_8xy7_SUBN, "OP_8xy7_SUBN" }, { &Chip8::OP_8xyE_SHL<false>, "OP_8xyE_SHL" },
+        { &Chip8::OP_9xy0_SNE, "OP_9xy0_SNE" }, { &Chip8::OP_Annn_LD, "OP_Annn_LD" },
+        { &Chip8::OP_Bnnn_JP<false>, "OP_Bnnn_JP" }, { &Chip8::OP_Cxkk_RND, "OP_Cxkk_RND" },
+        { &Chip8::OP_Dxyn_DRW, "OP_Dxyn_DRW" }, { &Chip8::OP_Ex9E_SKP, "OP_Ex9E_SKP" },
+        { &Chip8::OP_ExA1_SKNP, "OP_ExA1_SKNP" }, { &Chip8::OP_Fx07_LD, "OP_Fx07_LD" },
+        { &Chip8::OP_Fx0A_LD, "OP_Fx0A_LD" }, { &Chip8::OP_Fx15_LD, "OP_Fx15_LD" },
+        { &Chip8::OP_Fx18_LD, "OP_Fx18_LD" }, { &Chip8::OP_Fx1E_ADD, "OP_Fx1E_ADD" },
+        { &Chip8::OP_Fx29_LD, "OP_Fx29_LD" }, { &Chip8::OP_Fx33_LD, "OP_Fx33_LD" },
+        { &Chip8::OP_Fx55_LD<INDEX_UNCHANGED>, "OP_Fx55_LD" }, { &Chip8::OP_Fx65_LD<INDEX_UNCHANGED>, "OP_Fx65_LD" },
+    };
+
+    // A quirk profile only changes what a handler does, never which handler an opcode reaches,
+    // so the default tables name the handlers of every profile
+    Chip8::opcodeTableFnPtr function = Chip8::lookup(opcode, DEFAULT_QUIRKS);
+    for (auto const& handler : handlers)
+        if (handler.function == function)
+            return handler.name;
+    return "NULL_OP_DO_NOTHING";
+}
+
+std::vector<Profiler::HandlerRow> Profiler::handlerRows() const {
+    std::vector<HandlerRow> rows;
+    for (unsigned int opcode = 0; opcode <= 0xFFFF; ++opcode){
+        if (opcodes[opcode] == 0)
+            continue;
+        char const* name = handlerName(opcode);
+        auto row = std::find_if(rows.begin(), rows.end(), [name](HandlerRow const& row){ return row.name == name; });
+        if (row == rows.end())
+            row = rows.insert(rows.end(), HandlerRow{ name, 0, 0, 0.0 });
+        row->instructions += opcodes[opcode];
+        row->samples += samples[opcode];
+        row->sampledNanoseconds += sampledNanoseconds[opcode];
+    }
+    std::sort(rows.begin(), rows.end(), [](HandlerRow const& a, HandlerRow const& b){ return a.instructions > b.instructions; });
+    return rows;
+}
+
+std::vector<Profiler::AddressRow> Profiler::addressRows(Chip8 const& machine) const {
+    std::vector<AddressRow> rows;
+    for (unsigned int address = 0; address <= 0xFFF; ++address){
+        if (addresses[address] == 0)
+            continue;
+        uint16_t opcode = (machine.memory[address] << 8u) | machine.memory[(address + 1) & 0xFFFu];
+        rows.push_back(AddressRow{ static_cast<uint16_t>(address), opcode, handlerName(opcode), addresses[address] });
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](AddressRow const& a, AddressRow const& b){ return a.instructions > b.instructions; });
+    return rows;
+}
+
+namespace {
+
+// Mean time of one sampled execution
+double meanNanoseconds(unsigned long long samples, double nanoseconds){
+    return samples > 0 ? nanoseconds / samples : 0.0;
+}
+
+}
+
+void Profiler::writeCsv(Chip8 const& machine, std::ostream& out) const {
+    unsigned long long total = getInstructions();
+    out << "kind,key,handler,instructions,share,samples,mean_ns,estimated_ns" << std::endl;
+    out << std::fixed;
+    for (HandlerRow const& row : handlerRows()){
+        double mean = meanNanoseconds(row.samples, row.sampledNanoseconds);
+        out << "handler," << row.name << ',' << row.name << ',' << row.instructions << ','
+            << std::setprecision(4) << (total > 0 ? double(row.instructions) / total : 0.0) << ','
+            << row.samples << ',' << std::setprecision(1) << mean << ',' << mean * row.instructions << std::endl;
+    }
+    for (AddressRow const& row : addressRows(machine)){
+        out << "address,0x" << std::hex << std::uppercase << std::setw(3) << std::setfill('0') << row.address
+            << std::dec << std::nouppercase << std::setfill(' ') << ',' << row.name << ',' << row.instructions << ','
+            << std::setprecision(4) << (total > 0 ? double(row.instructions) / total : 0.0) << ",,," << std::endl;
+    }
+}
+
+void Profiler::writeJson(Chip8 const& machine, std::ostream& out) const {
+    unsigned long long total = getInstructions();
+    out << "{" << std::endl;
+    out << "  \"dispatch\": \"" << Chip8::dispatchName() << "\"," << std::endl;
+    out << "  \"instructions\": " << total << "," << std::endl;
+    out << "  \"sampleInterval\": " << SAMPLE_INTERVAL << "," << std::endl;
+    out << std::fixed << std::setprecision(1) << "  \"clockOverheadNs\": " << clockOverhead << "," << std::endl;
+
+    out << "  \"handlers\": [";
+    char const* separator = "";
+    for (HandlerRow const& row : handlerRows()){
+        double mean = meanNanoseconds(row.samples, row.sampledNanoseconds);
+        out << separator << std::endl << "    { \"handler\": \"" << row.name << "\", \"instructions\": " << row.instructions
+            << ", \"samples\": " << row.samples << ", \"meanNs\": " << mean << ", \"estimatedNs\": " << mean * row.instructions << " }";
+        separator = ",";
+    }
+    out << std::endl << "  ]," << std::endl;
+
+    out << "  \"addresses\": [";
+    separator = "";
+    for (AddressRow const& row : addressRows(machine)){
+        out << separator << std::endl << "    { \"address\": " << row.address << ", \"opcode\": " << row.opcode
+            << ", \"handler\": \"" << row.name << "\", \"instructions\": " << row.instructions << " }";
+        separator = ",";
+    }
+    out << std::endl << "  ]" << std::endl;
+    out << "}" << std::endl;
+}
+
+bool Profiler::write(Chip8 const& machine, char const* path) const {
+    std::ofstream out(path);
+    size_t length = std::strlen(path);
+    if (length >= 5 && std::strcmp(path + length - 5, ".json") == 0)
+        writeJson(machine, out);
+    else
+        writeCsv(machine, out);
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,72 @@
+#ifndef PROFILER_HEADER
+#define PROFILER_HEADER
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "chip8.h"
+
+// Counts what a Chip8 executes: every instruction by opcode and by address, and the host time
+// spent in the handler of one instruction out of every SAMPLE_INTERVAL.
+// Attached with Chip8::setProfiler(), which only exists when built with CHIP8_PROFILE (make PROFILE=1),
+// otherwise Chip8::cycle() carries no trace of it. Only instructions run through Chip8::cycle() are seen.
+// Not thread safe, give every machine its own.
+class Profiler {
+public:
+    typedef std::chrono::steady_clock clk;
+
+    // Odd, so the samples don't keep landing on the same instruction of a loop
+    static const unsigned int SAMPLE_INTERVAL = 61;
+
+    Profiler();
+
+    // Counts the instruction about to run at address, true when its handler should be timed
+    bool count(uint16_t address, uint16_t opcode){
+        ++opcodes[opcode];
+        ++addresses[address & 0xFFFu];
+        if (--untilSample != 0)
+            return false;
+        untilSample = SAMPLE_INTERVAL;
+        return true;
+    }
+    // Adds the time one handler of opcode took, from start to end
+    void addSample(uint16_t opcode, clk::time_point start, clk::time_point end);
+
+    unsigned long long getInstructions() const;
+
+    // Writes one row per handler and one per address that ran, busiest first.
+    // Handler names come from the opcode tables, and the instruction shown
+    // at an address is the one in its memory now
+    void writeCsv(Chip8 const& machine, std::ostream& out) const;
+    void writeJson(Chip8 const& machine, std::ostream& out) const;
+    // Writes JSON when path ends in .json and CSV otherwise, false when the file can't be written
+    bool write(Chip8 const& machine, char const* path) const;
+
+private:
+    struct HandlerRow {
+        char const* name;
+        unsigned long long instructions;
+        unsigned long long samples;
+        double sampledNanoseconds;
+    };
+    struct AddressRow {
+        uint16_t address;
+        uint16_t opcode; // in memory when the report was written
+        char const* name;
+        unsigned long long instructions;
+    };
+    std::vector<HandlerRow> handlerRows() const;
+    std::vector<AddressRow> addressRows(Chip8 const& machine) const;
+    static char const* handlerName(uint16_t opcode);
+
+    std::vector<unsigned long long> opcodes; // executions of each opcode
+    std::vector<unsigned long long> addresses; // executions at each address
+    std::vector<unsigned long long> samples; // timed executions of each opcode
+    std::vector<double> sampledNanoseconds; // their total time
+    unsigned int untilSample;
+    double clockOverhead; // nanoseconds a pair of clock reads adds to every sample
+};
+
+#endif
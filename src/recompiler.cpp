@@ -0,0 +1,233 @@
+#include "recompiler.h"
+
+// Longest run of operations translated into one block
+const unsigned int MAX_BLOCK_OPS = 64;
+// Highest address an instruction can start at without its fetch wrapping around memory
+const uint16_t LAST_INSTRUCTION_ADDRESS = 0xFFE;
+
+// Instructions that skip the one after them.
+// Classified by the function the opcode resolves to, as the tables ignore some of the opcode's digits
+bool Recompiler::isSkip(Chip8::opcodeTableFnPtr function){
+    return function == &Chip8::OP_3xkk_SE || function == &Chip8::OP_4xkk_SNE
+        || function == &Chip8::OP_5xy0_SE || function == &Chip8::OP_9xy0_SNE
+        || function == &Chip8::OP_Ex9E_SKP || function == &Chip8::OP_ExA1_SKNP;
+}
+
+// Instructions that end a block: anything that reads or sets pc, waits for a key,
+// or writes memory (so blocks translated from the written bytes are dropped before running again)
+bool Recompiler::endsBlock(Chip8::opcodeTableFnPtr function){
+    return isSkip(function)
+        || function == &Chip8::OP_00EE_RET || function == &Chip8::OP_1nnn_JP
+        || function == &Chip8::OP_2nnn_CALL || function == &Chip8::OP_Bnnn_JP<false>
+        || function == &Chip8::OP_Bnnn_JP<true> || function == &Chip8::OP_Fx0A_LD
+        || function == &Chip8::OP_Fx33_LD || function == &Chip8::OP_Fx55_LD<INDEX_UNCHANGED>
+        || function == &Chip8::OP_Fx55_LD<INDEX_PLUS_X> || function == &Chip8::OP_Fx55_LD<INDEX_PLUS_X_PLUS_1>;
+}
+
+Recompiler::Recompiler(Chip8& device) : device(device), blocks(4096) {
+    blocksTranslated = 0;
+    blocksInvalidated = 0;
+}
+
+void Recompiler::flush(){
+    for (std::unique_ptr<Block>& block : blocks)
+        block.reset();
+    translated.reset();
+}
+
+unsigned long Recompiler::getBlocksTranslated() const {
+    return blocksTranslated;
+}
+
+unsigned long Recompiler::getBlocksInvalidated() const {
+    return blocksInvalidated;
+}
+
+Recompiler::Block* Recompiler::translate(uint16_t start){
+    Block* block = new Block();
+    block->start = start;
+    block->instructions = 0;
+    block->terminated = false;
+
+    uint16_t address = start;
+    while (address <= LAST_INSTRUCTION_ADDRESS && block->ops.size() < MAX_BLOCK_OPS){
+        Op op{};
+        op.address = address;
+        op.instruction = decode((device.memory[address] << 8u) | device.memory[address + 1]);
+        op.function = device.lookup(op.instruction.opcode);
+        op.length = 1;
+        op.execute = interpret;
+
+        uint16_t following = address + 2;
+        bool hasFollowing = following <= LAST_INSTRUCTION_ADDRESS;
+        Instruction next = decode(hasFollowing ? (device.memory[following] << 8u) | device.memory[following + 1] : 0);
+
+        if (isSkip(op.function) && hasFollowing && device.lookup(next.opcode) == &Chip8::OP_1nnn_JP){
+            // A compare guarding a jump is a conditional branch
+            op.execute = skipOrJump;
+            op.next = next;
+            op.length = 2;
+        }
+        else if (endsBlock(op.function)){
+            op.execute = interpretLast;
+        }
+        else if (op.function == &Chip8::OP_6xkk_LD){
+            // LD Vx, byte then any number of ADD Vx, byte fold into a single load
+            op.execute = load;
+            op.value = op.instruction.kk;
+            while (hasFollowing && device.lookup(next.opcode) == &Chip8::OP_7xkk_ADD && next.x == op.instruction.x && op.length < 0xFF){
+                op.execute = loadAdd;
+                op.value += next.kk;
+                op.next = next;
+                ++op.length;
+                following += 2;
+                hasFollowing = following <= LAST_INSTRUCTION_ADDRESS;
+                next = decode(hasFollowing ? (device.memory[following] << 8u) | device.memory[following + 1] : 0);
+            }
+        }
+        else if (op.function == &Chip8::OP_7xkk_ADD){
+            op.execute = add;
+        }
+        else if (op.function == &Chip8::OP_Annn_LD){
+            op.execute = loadIndex;
+        }
+
+        block->ops.push_back(op);
+        block->instructions += op.length;
+        block->lastOpcode = op.length == 1 ? op.instruction.opcode : op.next.opcode;
+        address += 2 * op.length;
+
+        if (op.execute == skipOrJump || op.execute == interpretLast){
+            block->terminated = true;
+            break;
+        }
+    }
+    block->end = address;
+
+    for (unsigned int i = block->start; i < block->end; ++i)
+        translated[i] = true;
+    blocks[start].reset(block);
+    ++blocksTranslated;
+    return block;
+}
+
+void Recompiler::invalidateWrites(){
+    unsigned int begin = device.writtenBegin;
+    unsigned int end = device.writtenEnd;
+    device.writtenBegin = 0;
+    device.writtenEnd = 0;
+
+    bool hit = false;
+    for (unsigned int i = begin; i < end && !hit; ++i)
+        hit = translated[i];
+    if (!hit)
+        return;
+
+    // Drop every block that overlaps the write and rebuild the map of translated bytes
+    translated.reset();
+    for (std::unique_ptr<Block>& block : blocks){
+        if (!block)
+            continue;
+        if (block->start < end && block->end > begin){
+            block.reset();
+            ++blocksInvalidated;
+            continue;
+        }
+        for (unsigned int i = block->start; i < block->end; ++i)
+            translated[i] = true;
+    }
+}
+
+unsigned long Recompiler::run(unsigned long budget){
+    unsigned long executed = 0;
+    while (executed < budget && !device.isIdle()){
+        if (device.writtenEnd > device.writtenBegin)
+            invalidateWrites();
+
+        uint16_t pc = device.pc;
+        Block* block = pc <= LAST_INSTRUCTION_ADDRESS ? blocks[pc].get() : nullptr;
+        if (block == nullptr && pc <= LAST_INSTRUCTION_ADDRESS)
+            block = translate(pc);
+
+        // Outside memory, or the first operation doesn't fit the budget: one instruction at a time
+        if (block == nullptr || block->ops.front().length > budget - executed){
+            device.cycle();
+            ++executed;
+            continue;
+        }
+
+        // Run as much of the block as the budget allows
+        std::vector<Op>::const_iterator op = block->ops.begin();
+        std::vector<Op>::const_iterator last = block->ops.end();
+        uint16_t lastOpcode = device.opcode;
+        for (; op != last && op->length <= budget - executed; ++op){
+            executed += op->execute(device, *op);
+            lastOpcode = op->length == 1 ? op->instruction.opcode : op->next.opcode;
+        }
+
+        if (op != last){
+            // Stopped early, the rest of the block runs next time
+            device.pc = op->address;
+            device.opcode = lastOpcode;
+        }
+        else if (!block->terminated){
+            device.pc = block->end;
+            device.opcode = block->lastOpcode;
+        }
+    }
+    return executed;
+}
+
+// Any instruction that doesn't depend on pc
+unsigned int Recompiler::interpret(Chip8& device, Op const& op){
+    (device.*op.function)(op.instruction);
+    return 1;
+}
+
+// The instruction that ends a block, runs with pc and opcode exactly as Chip8::cycle() leaves them
+unsigned int Recompiler::interpretLast(Chip8& device, Op const& op){
+    device.pc = op.address + 2;
+    device.opcode = op.instruction.opcode;
+    (device.*op.function)(op.instruction);
+    return 1;
+}
+
+// LD Vx, byte
+unsigned int Recompiler::load(Chip8& device, Op const& op){
+    device.registers[op.instruction.x] = op.instruction.kk;
+    return 1;
+}
+
+// ADD Vx, byte
+unsigned int Recompiler::add(Chip8& device, Op const& op){
+    device.registers[op.instruction.x] += op.instruction.kk;
+    return 1;
+}
+
+// LD I, addr
+unsigned int Recompiler::loadIndex(Chip8& device, Op const& op){
+    device.index = op.instruction.nnn;
+    return 1;
+}
+
+// LD Vx, byte followed by ADD Vx, byte: loads the sum
+unsigned int Recompiler::loadAdd(Chip8& device, Op const& op){
+    device.registers[op.instruction.x] = op.value;
+    return op.length;
+}
+
+// A skip followed by JP addr: either skips over the jump, or takes it
+unsigned int Recompiler::skipOrJump(Chip8& device, Op const& op){
+    uint16_t following = op.address + 2;
+    device.pc = following;
+    device.opcode = op.instruction.opcode;
+    (device.*op.function)(op.instruction);
+    if (device.pc != following)
+        return 1; // skipped, the jump never ran
+
+    if (op.next.nnn <= op.address + 2)
+        device.checkIdleLoop(op.address + 2, op.next.nnn);
+    device.pc = op.next.nnn;
+    device.opcode = op.next.opcode;
+    return 2;
+}
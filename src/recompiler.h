@@ -0,0 +1,76 @@
+#ifndef RECOMPILER_HEADER
+#define RECOMPILER_HEADER
+
+#include <bitset>
+#include <memory>
+#include <vector>
+
+#include "chip8.h"
+
+// An alternative to calling Chip8::cycle() once per instruction.
+// Straight runs of instructions (basic blocks) are translated once into a chain of operations,
+// cached by their start address and replayed on the next visit.
+// Common pairs are fused into one operation: LD Vx, byte followed by ADD Vx, byte,
+// and any skip followed by the jump it guards.
+// Blocks are dropped when the program writes to memory they were translated from.
+class Recompiler {
+public:
+    Recompiler(Chip8& device);
+
+    // Executes `budget` instructions, as `budget` calls to Chip8::cycle() would.
+    // Stops early once the device is idle, returns the number of instructions executed
+    unsigned long run(unsigned long budget);
+    // Forget every translated block, e.g. after loading another ROM
+    void flush();
+
+    unsigned long getBlocksTranslated() const;
+    unsigned long getBlocksInvalidated() const;
+
+private:
+    struct Op;
+    // Executes an operation, returns the number of instructions it covered this time
+    typedef unsigned int (*OpFn)(Chip8& device, Op const& op);
+
+    struct Op {
+        OpFn execute;
+        Chip8::opcodeTableFnPtr function; // opcode function for the generic operations
+        Instruction instruction;
+        Instruction next; // second instruction of a fused pair
+        uint16_t address; // address of the operation's first instruction
+        uint8_t value; // immediate folded from a fused sequence
+        uint8_t length; // instructions covered by a fused sequence
+    };
+
+    struct Block {
+        uint16_t start; // address of the first instruction
+        uint16_t end; // one past the last byte read
+        unsigned long instructions; // instructions executed when the block runs to the end
+        bool terminated; // ends in an instruction that sets pc itself
+        uint16_t lastOpcode;
+        std::vector<Op> ops;
+    };
+
+    static bool isSkip(Chip8::opcodeTableFnPtr function);
+    static bool endsBlock(Chip8::opcodeTableFnPtr function);
+
+    Block* translate(uint16_t start);
+    // Drops blocks translated from memory the program has written to since the last check
+    void invalidateWrites();
+
+    // Operations
+    static unsigned int interpret(Chip8& device, Op const& op);
+    static unsigned int interpretLast(Chip8& device, Op const& op);
+    static unsigned int load(Chip8& device, Op const& op);
+    static unsigned int add(Chip8& device, Op const& op);
+    static unsigned int loadIndex(Chip8& device, Op const& op);
+    static unsigned int loadAdd(Chip8& device, Op const& op);
+    static unsigned int skipOrJump(Chip8& device, Op const& op);
+
+    Chip8& device;
+    std::vector<std::unique_ptr<Block>> blocks; // by start address
+    std::bitset<4096> translated; // bytes some block was translated from
+    unsigned long blocksTranslated;
+    unsigned long blocksInvalidated;
+};
+
+#endif
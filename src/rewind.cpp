@@ -0,0 +1,202 @@
+#include "rewind.h"
+#include "scheduler.h"
+
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<RandomState>::value, "the random state is stored as raw bytes");
+
+// Where each field of a snapshot lives in an image
+const size_t MEMORY_OFFSET = 0;
+const size_t DISPLAY_OFFSET = MEMORY_OFFSET + MEMORY_PAGES * MEMORY_PAGE_SIZE;
+const size_t REGISTERS_OFFSET = DISPLAY_OFFSET + sizeof(Snapshot::displayMemory);
+const size_t STACK_OFFSET = REGISTERS_OFFSET + sizeof(Snapshot::registers);
+const size_t INDEX_OFFSET = STACK_OFFSET + sizeof(Snapshot::stack);
+const size_t PC_OFFSET = INDEX_OFFSET + sizeof(Snapshot::index);
+const size_t OPCODE_OFFSET = PC_OFFSET + sizeof(Snapshot::pc);
+const size_t SP_OFFSET = OPCODE_OFFSET + sizeof(Snapshot::opcode);
+const size_t DELAY_OFFSET = SP_OFFSET + sizeof(Snapshot::sp);
+const size_t SOUND_OFFSET = DELAY_OFFSET + sizeof(Snapshot::delayTimer);
+const size_t KEYPAD_OFFSET = SOUND_OFFSET + sizeof(Snapshot::soundTimer);
+const size_t RANDOM_OFFSET = KEYPAD_OFFSET + sizeof(Snapshot::keypad);
+const size_t IMAGE_SIZE = RANDOM_OFFSET + sizeof(Snapshot::random);
+
+namespace {
+
+void putVarint(std::vector<uint8_t>& out, size_t value){
+    while (value >= 0x80u){
+        out.push_back((value & 0x7Fu) | 0x80u);
+        value >>= 7u;
+    }
+    out.push_back(value);
+}
+
+size_t getVarint(std::vector<uint8_t> const& in, size_t& position){
+    size_t value = 0;
+    for (unsigned int shift = 0; position < in.size(); shift += 7){
+        uint8_t byte = in[position++];
+        value |= size_t(byte & 0x7Fu) << shift;
+        if (!(byte & 0x80u))
+            break;
+    }
+    return value;
+}
+
+}
+
+RewindBuffer::RewindBuffer(Chip8& device, unsigned int seconds, size_t maxBytes)
+    : snapshotter(device), maxFrames(size_t(seconds) * Scheduler::FRAME_RATE), maxBytes(maxBytes), frames(0), bytes(0) {
+}
+
+size_t RewindBuffer::getFrames() const {
+    return frames;
+}
+
+size_t RewindBuffer::getBytes() const {
+    return bytes;
+}
+
+void RewindBuffer::push(){
+    latest = snapshotter.take();
+    toImage(latest, scratch);
+
+    if (segments.empty() || segments.back().deltas.size() + 1 >= KEYFRAME_INTERVAL){
+        Segment segment;
+        segment.keyframe = scratch;
+        segment.bytes = scratch.size();
+        bytes += segment.bytes;
+        segments.push_back(std::move(segment));
+    }
+    else {
+        Segment& segment = segments.back();
+        std::vector<uint8_t> delta;
+        encodeDelta(scratch, segment.keyframe, delta);
+        segment.bytes += delta.size();
+        bytes += delta.size();
+        segment.deltas.push_back(std::move(delta));
+    }
+    ++frames;
+
+    // Drop whole segments from the oldest end, but never the one being added to
+    while (segments.size() > 1){
+        Segment const& oldest = segments.front();
+        size_t oldestFrames = 1 + oldest.deltas.size();
+        if (frames - oldestFrames < maxFrames && bytes <= maxBytes)
+            break;
+        frames -= oldestFrames;
+        bytes -= oldest.bytes;
+        segments.pop_front();
+    }
+}
+
+bool RewindBuffer::stepBack(){
+    // The newest state is where the device already is, the one before it is restored
+    if (frames < 2)
+        return false;
+
+    Segment& newest = segments.back();
+    if (!newest.deltas.empty()){
+        newest.bytes -= newest.deltas.back().size();
+        bytes -= newest.deltas.back().size();
+        newest.deltas.pop_back();
+    }
+    else {
+        bytes -= newest.bytes;
+        segments.pop_back();
+    }
+    --frames;
+
+    Segment const& previous = segments.back();
+    if (previous.deltas.empty())
+        scratch = previous.keyframe;
+    else
+        decodeDelta(previous.deltas.back(), previous.keyframe, scratch);
+
+    Snapshot snapshot;
+    fromImage(scratch, latest, snapshot);
+    snapshotter.restore(snapshot);
+    latest = snapshot;
+    return true;
+}
+
+void RewindBuffer::toImage(Snapshot const& snapshot, Image& image){
+    image.resize(IMAGE_SIZE);
+    uint8_t* data = image.data();
+    for (unsigned int page = 0; page < MEMORY_PAGES; ++page)
+        std::memcpy(data + MEMORY_OFFSET + page * MEMORY_PAGE_SIZE, snapshot.pages[page]->data(), MEMORY_PAGE_SIZE);
+    std::memcpy(data + DISPLAY_OFFSET, snapshot.displayMemory, sizeof(snapshot.displayMemory));
+    std::memcpy(data + REGISTERS_OFFSET, snapshot.registers, sizeof(snapshot.registers));
+    std::memcpy(data + STACK_OFFSET, snapshot.stack, sizeof(snapshot.stack));
+    std::memcpy(data + INDEX_OFFSET, &snapshot.index, sizeof(snapshot.index));
+    std::memcpy(data + PC_OFFSET, &snapshot.pc, sizeof(snapshot.pc));
+    std::memcpy(data + OPCODE_OFFSET, &snapshot.opcode, sizeof(snapshot.opcode));
+    std::memcpy(data + SP_OFFSET, &snapshot.sp, sizeof(snapshot.sp));
+    std::memcpy(data + DELAY_OFFSET, &snapshot.delayTimer, sizeof(snapshot.delayTimer));
+    std::memcpy(data + SOUND_OFFSET, &snapshot.soundTimer, sizeof(snapshot.soundTimer));
+    std::memcpy(data + KEYPAD_OFFSET, snapshot.keypad, sizeof(snapshot.keypad));
+    std::memcpy(data + RANDOM_OFFSET, &snapshot.random, sizeof(snapshot.random));
+}
+
+void RewindBuffer::fromImage(Image const& image, Snapshot const& reuse, Snapshot& snapshot){
+    uint8_t const* data = image.data();
+    for (unsigned int page = 0; page < MEMORY_PAGES; ++page){
+        uint8_t const* bytes = data + MEMORY_OFFSET + page * MEMORY_PAGE_SIZE;
+        if (reuse.pages[page] && std::memcmp(reuse.pages[page]->data(), bytes, MEMORY_PAGE_SIZE) == 0){
+            snapshot.pages[page] = reuse.pages[page];
+            continue;
+        }
+        std::shared_ptr<Snapshot::Page> copy = std::make_shared<Snapshot::Page>();
+        std::memcpy(copy->data(), bytes, MEMORY_PAGE_SIZE);
+        snapshot.pages[page] = copy;
+    }
+    std::memcpy(snapshot.displayMemory, data + DISPLAY_OFFSET, sizeof(snapshot.displayMemory));
+    std::memcpy(snapshot.registers, data + REGISTERS_OFFSET, sizeof(snapshot.registers));
+    std::memcpy(snapshot.stack, data + STACK_OFFSET, sizeof(snapshot.stack));
+    std::memcpy(&snapshot.index, data + INDEX_OFFSET, sizeof(snapshot.index));
+    std::memcpy(&snapshot.pc, data + PC_OFFSET, sizeof(snapshot.pc));
+    std::memcpy(&snapshot.opcode, data + OPCODE_OFFSET, sizeof(snapshot.opcode));
+    std::memcpy(&snapshot.sp, data + SP_OFFSET, sizeof(snapshot.sp));
+    std::memcpy(&snapshot.delayTimer, data + DELAY_OFFSET, sizeof(snapshot.delayTimer));
+    std::memcpy(&snapshot.soundTimer, data + SOUND_OFFSET, sizeof(snapshot.soundTimer));
+    std::memcpy(snapshot.keypad, data + KEYPAD_OFFSET, sizeof(snapshot.keypad));
+    std::memcpy(&snapshot.random, data + RANDOM_OFFSET, sizeof(snapshot.random));
+}
+
+// A delta is a list of (unchanged byte count, changed byte count, changed bytes XOR keyframe) covering the image
+void RewindBuffer::encodeDelta(Image const& image, Image const& keyframe, std::vector<uint8_t>& delta){
+    delta.clear();
+    size_t size = image.size();
+    size_t i = 0;
+    while (i < size){
+        // Unchanged run, a word at a time where possible
+        size_t unchangedStart = i;
+        while (i + 8 <= size && std::memcmp(&image[i], &keyframe[i], 8) == 0)
+            i += 8;
+        while (i < size && image[i] == keyframe[i])
+            ++i;
+        if (i == size)
+            break; // the rest matches, nothing to record
+
+        // Changed run, ends at the first two unchanged bytes in a row
+        size_t changedStart = i;
+        while (i < size && !(image[i] == keyframe[i] && (i + 1 == size || image[i + 1] == keyframe[i + 1])))
+            ++i;
+
+        putVarint(delta, changedStart - unchangedStart);
+        putVarint(delta, i - changedStart);
+        for (size_t j = changedStart; j < i; ++j)
+            delta.push_back(image[j] ^ keyframe[j]);
+    }
+}
+
+void RewindBuffer::decodeDelta(std::vector<uint8_t> const& delta, Image const& keyframe, Image& image){
+    image = keyframe;
+    size_t position = 0;
+    size_t i = 0;
+    while (position < delta.size()){
+        i += getVarint(delta, position);
+        size_t changed = getVarint(delta, position);
+        for (size_t j = 0; j < changed && position < delta.size() && i < image.size(); ++j)
+            image[i++] ^= delta[position++];
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef REWIND_HEADER
+#define REWIND_HEADER
+
+#include <deque>
+#include <vector>
+
+#include "chip8.h"
+#include "snapshot.h"
+
+// Keeps the last few seconds of a device's state, one entry per frame, so play can be stepped backwards.
+// Every KEYFRAME_INTERVAL frames the whole state is stored as a keyframe, the frames in between as the
+// XOR against their keyframe with runs of unchanged (zero) bytes left out, which is usually a few dozen bytes.
+// The oldest keyframe and its frames are dropped once either the length or the memory cap is reached
+class RewindBuffer {
+public:
+    static const unsigned int KEYFRAME_INTERVAL = 60;
+
+    RewindBuffer(Chip8& device, unsigned int seconds, size_t maxBytes);
+
+    // Records the device's state, call once at the end of every frame
+    void push();
+    // Puts the device back to the newest state recorded and forgets it, so each call goes one frame further back.
+    // Returns false when nothing is left
+    bool stepBack();
+
+    size_t getFrames() const;
+    size_t getBytes() const;
+
+private:
+    // The state laid out as a fixed size array of bytes
+    typedef std::vector<uint8_t> Image;
+
+    // A keyframe and the frames recorded after it
+    struct Segment {
+        Image keyframe;
+        std::vector<std::vector<uint8_t>> deltas; // XOR against keyframe, run length encoded
+        size_t bytes;
+    };
+
+    static void toImage(Snapshot const& snapshot, Image& image);
+    // Pages whose bytes match reuse, so the device only copies pages that really change
+    static void fromImage(Image const& image, Snapshot const& reuse, Snapshot& snapshot);
+    static void encodeDelta(Image const& image, Image const& keyframe, std::vector<uint8_t>& delta);
+    static void decodeDelta(std::vector<uint8_t> const& delta, Image const& keyframe, Image& image);
+
+    Snapshotter snapshotter;
+    size_t maxFrames;
+    size_t maxBytes;
+    std::deque<Segment> segments;
+    size_t frames;
+    size_t bytes;
+    Snapshot latest; // last state pushed or stepped back to
+    Image scratch;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef RING_HEADER
+#define RING_HEADER
+
+#include <atomic>
+#include <cstddef>
+
+// A fixed size queue from one producer thread to one consumer thread, without locks or allocation.
+// Each side only writes its own index, and reads the other's to find out how far it may go.
+// The indices are a cache line apart so the two threads don't keep stealing one line from each other
+// (padded rather than aligned, C++11 new doesn't honour alignments past the default)
+template<class T, size_t CAPACITY>
+class SpscRing {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+public:
+    SpscRing() : head(0), tail(0) {}
+
+    // Producer: appends value, false when the ring is full and value was dropped
+    bool push(T const& value){
+        size_t end = tail.load(std::memory_order_relaxed);
+        if (end - head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+        slots[end & (CAPACITY - 1)] = value;
+        tail.store(end + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer: the oldest value, nullptr when the ring is empty. It stays in place until pop()
+    T const* front() const {
+        size_t begin = head.load(std::memory_order_relaxed);
+        if (begin == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &slots[begin & (CAPACITY - 1)];
+    }
+    // Consumer: drops the value front() returned
+    void pop(){
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    static const size_t CACHE_LINE = 64;
+
+    std::atomic<size_t> head; // next value to read, only written by the consumer
+    char headPadding[CACHE_LINE];
+    std::atomic<size_t> tail; // next slot to write, only written by the producer
+    char tailPadding[CACHE_LINE];
+    T slots[CAPACITY];
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "romstore.h"
+#include "chip8.h"
+#include "hash.h"
+
+#if defined(_WIN32)
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+RomImage::RomImage() : bytes(nullptr), length(0), hash(0), mapping(nullptr) {
+}
+
+RomImage::~RomImage(){
+#if !defined(_WIN32)
+    if (mapping != nullptr)
+        munmap(mapping, length);
+#endif
+}
+
+uint8_t const* RomImage::data() const {
+    return bytes;
+}
+
+size_t RomImage::size() const {
+    return length;
+}
+
+uint64_t RomImage::getHash() const {
+    return hash;
+}
+
+std::string const& RomImage::getPath() const {
+    return path;
+}
+
+bool RomImage::map(char const* path, std::string& error){
+    this->path = path;
+#if defined(_WIN32)
+    // Read in whole, one byte past what fits shows the file is too large
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()){
+        error = "could not open \"" + this->path + "\"";
+        return false;
+    }
+    copy.resize(MAX_ROM_SIZE + 1);
+    file.read(reinterpret_cast<char*>(copy.data()), copy.size());
+    copy.resize(file.gcount());
+    length = copy.size();
+#else
+    int descriptor = ::open(path, O_RDONLY);
+    if (descriptor < 0){
+        error = "could not open \"" + this->path + "\"";
+        return false;
+    }
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)){
+        close(descriptor);
+        error = "\"" + this->path + "\" is not a file";
+        return false;
+    }
+    length = status.st_size;
+#endif
+
+    if (length == 0 || length > MAX_ROM_SIZE){
+#if !defined(_WIN32)
+        close(descriptor);
+#endif
+        error = "\"" + this->path + "\" is " + std::to_string(length) + " bytes, a rom has 1 to "
+              + std::to_string(MAX_ROM_SIZE) + " bytes";
+        length = 0;
+        return false;
+    }
+
+#if defined(_WIN32)
+    bytes = copy.data();
+#else
+    // The mapping stays valid after the descriptor is closed
+    mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+    close(descriptor);
+    if (mapping == MAP_FAILED){
+        mapping = nullptr;
+        length = 0;
+        error = "could not map \"" + this->path + "\"";
+        return false;
+    }
+    bytes = static_cast<uint8_t const*>(mapping);
+#endif
+    hash = fnv1a(bytes, length);
+    return true;
+}
+
+std::shared_ptr<RomImage const> RomStore::open(char const* path, std::string* error){
+    std::lock_guard<std::mutex> guard(lock);
+    auto cached = images.find(path);
+    if (cached != images.end())
+        return cached->second;
+
+    std::shared_ptr<RomImage> image(new RomImage());
+    std::string reason;
+    if (!image->map(path, reason)){
+        if (error)
+            *error = reason;
+        return nullptr;
+    }
+    images[path] = image;
+    return image;
+}
+
+size_t RomStore::size(){
+    std::lock_guard<std::mutex> guard(lock);
+    return images.size();
+}
+
+RomStore& RomStore::shared(){
+    static RomStore store;
+    return store;
+}
@@ -0,0 +1,57 @@
+#ifndef ROMSTORE_HEADER
+#define ROMSTORE_HEADER
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A rom file mapped into memory read only, checked to fit in the Chip8's memory.
+// Any number of machines load from the one image, see Chip8::LoadROM(RomImage const&)
+class RomImage {
+public:
+    ~RomImage();
+    RomImage(RomImage const&) = delete;
+    RomImage& operator=(RomImage const&) = delete;
+
+    uint8_t const* data() const;
+    size_t size() const; // between 1 and MAX_ROM_SIZE bytes
+    uint64_t getHash() const; // fnv1a() of the contents
+    std::string const& getPath() const;
+
+private:
+    friend class RomStore;
+    RomImage();
+    // Maps the file at path, false with error set when it can't be read or doesn't fit
+    bool map(char const* path, std::string& error);
+
+    std::string path;
+    uint8_t const* bytes;
+    size_t length;
+    uint64_t hash;
+    void* mapping; // the mapped file, nullptr where bytes point into copy instead
+    std::vector<uint8_t> copy; // the file read in, on hosts without mmap
+};
+
+// Maps each rom file once, later requests for the same path get the same image.
+// Safe to use from several threads
+class RomStore {
+public:
+    // The image of the rom at path, nullptr when it can't be read or doesn't fit in memory,
+    // then error (when given) says why
+    std::shared_ptr<RomImage const> open(char const* path, std::string* error = nullptr);
+    // Images mapped so far
+    size_t size();
+
+    // One store for the whole program
+    static RomStore& shared();
+
+private:
+    std::mutex lock; // guards images
+    std::map<std::string, std::shared_ptr<RomImage const>> images;
+};
+
+#endif
@@ -0,0 +1,80 @@
+#include "scheduler.h"
+
+#include <climits>
+
+// Unlimited frames check the host clock once per batch of this many instructions
+const unsigned int UNLIMITED_BATCH = 256;
+
+Scheduler::Scheduler(Chip8& device, unsigned int instructionsPerSecond, ExecutionMode mode) : device(device) {
+    cycles = 0;
+    setInstructionsPerSecond(instructionsPerSecond);
+    if (mode == RECOMPILER)
+        recompiler.reset(new Recompiler(device));
+}
+
+void Scheduler::setInstructionsPerSecond(unsigned int instructionsPerSecond){
+    if (instructionsPerSecond == UNLIMITED){
+        instructionsPerFrame = UNLIMITED;
+        return;
+    }
+    // Round to the nearest whole budget, but always make progress
+    instructionsPerFrame = (instructionsPerSecond + FRAME_RATE / 2) / FRAME_RATE;
+    if (instructionsPerFrame == 0)
+        instructionsPerFrame = 1;
+}
+
+unsigned int Scheduler::getInstructionsPerFrame() const {
+    return instructionsPerFrame;
+}
+
+Scheduler::clk::duration Scheduler::framePeriod(){
+    return std::chrono::duration_cast<clk::duration>(std::chrono::nanoseconds(1000000000ull / FRAME_RATE));
+}
+
+unsigned long Scheduler::runFrame(clk::time_point deadline){
+    if (instructionsPerFrame != UNLIMITED)
+        return runFrame();
+
+    device.clearIdle();
+    unsigned long executed = 0;
+    do {
+        executed += execute(UNLIMITED_BATCH);
+    } while (!device.isIdle() && clk::now() < deadline);
+
+    device.tickTimers();
+    return executed;
+}
+
+unsigned long Scheduler::runFrame(){
+    return runFrame(ULONG_MAX);
+}
+
+unsigned long Scheduler::runFrame(unsigned long limit){
+    // Without a deadline an unlimited budget would never end, so run a single batch
+    unsigned long budget = instructionsPerFrame != UNLIMITED ? instructionsPerFrame : UNLIMITED_BATCH;
+    if (budget > limit)
+        budget = limit;
+    device.clearIdle();
+    unsigned long executed = execute(budget);
+
+    device.tickTimers();
+    return executed;
+}
+
+unsigned long Scheduler::execute(unsigned long instructions){
+    unsigned long executed = 0;
+    if (recompiler)
+        executed = recompiler->run(instructions);
+    else {
+        while (executed < instructions && !device.isIdle()){
+            device.cycle();
+            ++executed;
+        }
+    }
+    cycles += executed;
+    return executed;
+}
+
+unsigned long long Scheduler::getCycles() const {
+    return cycles;
+}
@@ -0,0 +1,52 @@
+#ifndef SCHEDULER_HEADER
+#define SCHEDULER_HEADER
+
+#include <chrono>
+#include <memory>
+
+#include "chip8.h"
+#include "recompiler.h"
+
+// How the scheduler executes instructions
+enum ExecutionMode {
+    INTERPRETER, // Chip8::cycle() per instruction
+    RECOMPILER // translated blocks, see Recompiler
+};
+
+// Runs a Chip8 in frames of 1/60th of a second of emulated time.
+// Each frame executes a fixed instruction budget and then ticks the timers exactly once,
+// so the instruction rate can be raised without changing the speed of the game's timers.
+class Scheduler {
+public:
+    typedef std::chrono::steady_clock clk;
+    static const unsigned int FRAME_RATE = 60; // timers and presentation run at 60 Hz
+    static const unsigned int UNLIMITED = 0; // as many instructions as fit in the frame
+
+    Scheduler(Chip8& device, unsigned int instructionsPerSecond, ExecutionMode mode = INTERPRETER);
+
+    void setInstructionsPerSecond(unsigned int instructionsPerSecond);
+    unsigned int getInstructionsPerFrame() const;
+    // Duration of one frame of emulated time
+    static clk::duration framePeriod();
+
+    // Runs one frame with a fixed budget and returns the number of instructions executed.
+    // An unlimited budget keeps executing until the host clock reaches the deadline.
+    // Once the program is idle (see Chip8::isIdle) the rest of the frame is skipped.
+    unsigned long runFrame(clk::time_point deadline);
+    unsigned long runFrame();
+    // As runFrame(), but executes no more than limit instructions, so a run can stop exactly at an instruction count
+    unsigned long runFrame(unsigned long limit);
+
+    // Executes this many instructions with the chosen execution mode, or fewer if the program goes idle
+    unsigned long execute(unsigned long instructions);
+    // Instructions executed so far, input movies use it to place key changes
+    unsigned long long getCycles() const;
+
+private:
+    Chip8& device;
+    unsigned int instructionsPerFrame;
+    unsigned long long cycles;
+    std::unique_ptr<Recompiler> recompiler; // only in RECOMPILER mode
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include "snapshot.h"
+
+#include <cstring>
+
+// Binary format: magic, version, then each field in order, integers little endian
+const char SNAPSHOT_MAGIC[4] = { 'C', '8', 'S', 'S' };
+const uint8_t SNAPSHOT_VERSION = 2;
+
+namespace {
+
+void put8(std::ostream& out, uint8_t value){
+    out.put(static_cast<char>(value));
+}
+
+void put16(std::ostream& out, uint16_t value){
+    put8(out, value & 0xFFu);
+    put8(out, value >> 8u);
+}
+
+void put64(std::ostream& out, uint64_t value){
+    for (unsigned int i = 0; i < 8; ++i)
+        put8(out, (value >> (8u * i)) & 0xFFu);
+}
+
+uint8_t get8(std::istream& in){
+    return static_cast<uint8_t>(in.get());
+}
+
+uint16_t get16(std::istream& in){
+    uint16_t low = get8(in);
+    return low | (get8(in) << 8u);
+}
+
+uint64_t get64(std::istream& in){
+    uint64_t value = 0;
+    for (unsigned int i = 0; i < 8; ++i)
+        value |= uint64_t(get8(in)) << (8u * i);
+    return value;
+}
+
+}
+
+Snapshotter::Snapshotter(Chip8& device) : device(device) {
+}
+
+Snapshot Snapshotter::take(){
+    Snapshot snapshot;
+    for (unsigned int page = 0; page < MEMORY_PAGES; ++page){
+        // Only pages written since the last snapshot (or never captured) get a fresh copy
+        if (!current[page] || (device.pagesWritten >> page) & 1u){
+            std::shared_ptr<Snapshot::Page> copy = std::make_shared<Snapshot::Page>();
+            std::memcpy(copy->data(), device.memory + page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+            current[page] = copy;
+        }
+        snapshot.pages[page] = current[page];
+    }
+    device.pagesWritten = 0;
+
+    std::memcpy(snapshot.registers, device.registers, sizeof(snapshot.registers));
+    snapshot.index = device.index;
+    snapshot.pc = device.pc;
+    std::memcpy(snapshot.stack, device.stack, sizeof(snapshot.stack));
+    snapshot.sp = device.sp;
+    snapshot.delayTimer = device.delayTimer;
+    snapshot.soundTimer = device.soundTimer;
+    snapshot.opcode = device.opcode;
+    std::memcpy(snapshot.displayMemory, device.displayMemory, sizeof(snapshot.displayMemory));
+    std::memcpy(snapshot.keypad, device.keypad, sizeof(snapshot.keypad));
+    snapshot.random = device.random;
+    return snapshot;
+}
+
+void Snapshotter::restore(Snapshot const& snapshot){
+    for (unsigned int page = 0; page < MEMORY_PAGES; ++page){
+        // Memory still matches this page unless it was written or belongs to another snapshot
+        if (snapshot.pages[page] == current[page] && !((device.pagesWritten >> page) & 1u))
+            continue;
+        std::memcpy(device.memory + page * MEMORY_PAGE_SIZE, snapshot.pages[page]->data(), MEMORY_PAGE_SIZE);
+        // Lets the recompiler and decode cache drop what they built from the old bytes
+        device.markMemoryWritten(page * MEMORY_PAGE_SIZE, MEMORY_PAGE_SIZE);
+        current[page] = snapshot.pages[page];
+    }
+    device.pagesWritten = 0;
+
+    std::memcpy(device.registers, snapshot.registers, sizeof(snapshot.registers));
+    device.index = snapshot.index;
+    device.pc = snapshot.pc;
+    std::memcpy(device.stack, snapshot.stack, sizeof(snapshot.stack));
+    device.sp = snapshot.sp;
+    device.delayTimer = snapshot.delayTimer;
+    device.soundTimer = snapshot.soundTimer;
+    device.opcode = snapshot.opcode;
+    std::memcpy(device.displayMemory, snapshot.displayMemory, sizeof(snapshot.displayMemory));
+    std::memcpy(device.keypad, snapshot.keypad, sizeof(snapshot.keypad));
+    device.random = snapshot.random;
+
+    device.markRowsDirty(0, VIDEO_HEIGHT);
+    device.clearIdle();
+}
+
+void Snapshotter::save(Snapshot const& snapshot, std::ostream& out){
+    out.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    put8(out, SNAPSHOT_VERSION);
+
+    for (unsigned int page = 0; page < MEMORY_PAGES; ++page)
+        out.write(reinterpret_cast<char const*>(snapshot.pages[page]->data()), MEMORY_PAGE_SIZE);
+    out.write(reinterpret_cast<char const*>(snapshot.registers), sizeof(snapshot.registers));
+    put16(out, snapshot.index);
+    put16(out, snapshot.pc);
+    for (uint16_t entry : snapshot.stack)
+        put16(out, entry);
+    put8(out, snapshot.sp);
+    put8(out, snapshot.delayTimer);
+    put8(out, snapshot.soundTimer);
+    put16(out, snapshot.opcode);
+    for (uint64_t row : snapshot.displayMemory)
+        put64(out, row);
+    out.write(reinterpret_cast<char const*>(snapshot.keypad), sizeof(snapshot.keypad));
+
+    put8(out, snapshot.random.generator);
+    put16(out, snapshot.random.standard & 0xFFFFu);
+    put16(out, snapshot.random.standard >> 16u);
+    put64(out, snapshot.random.xorshift);
+    out.write(reinterpret_cast<char const*>(snapshot.random.buffer), sizeof(snapshot.random.buffer));
+    put8(out, snapshot.random.bufferLeft);
+}
+
+bool Snapshotter::load(std::istream& in, Snapshot& snapshot){
+    char magic[sizeof(SNAPSHOT_MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0 || get8(in) != SNAPSHOT_VERSION)
+        return false;
+
+    Snapshot loaded;
+    for (unsigned int page = 0; page < MEMORY_PAGES; ++page){
+        std::shared_ptr<Snapshot::Page> copy = std::make_shared<Snapshot::Page>();
+        in.read(reinterpret_cast<char*>(copy->data()), MEMORY_PAGE_SIZE);
+        loaded.pages[page] = copy;
+    }
+    in.read(reinterpret_cast<char*>(loaded.registers), sizeof(loaded.registers));
+    loaded.index = get16(in);
+    loaded.pc = get16(in);
+    for (uint16_t& entry : loaded.stack)
+        entry = get16(in);
+    loaded.sp = get8(in);
+    loaded.delayTimer = get8(in);
+    loaded.soundTimer = get8(in);
+    loaded.opcode = get16(in);
+    for (uint64_t& row : loaded.displayMemory)
+        row = get64(in);
+    in.read(reinterpret_cast<char*>(loaded.keypad), sizeof(loaded.keypad));
+
+    uint8_t generator = get8(in);
+    loaded.random.generator = static_cast<RandomGenerator>(generator);
+    loaded.random.standard = get16(in);
+    loaded.random.standard |= uint32_t(get16(in)) << 16u;
+    loaded.random.xorshift = get64(in);
+    in.read(reinterpret_cast<char*>(loaded.random.buffer), sizeof(loaded.random.buffer));
+    loaded.random.bufferLeft = get8(in);
+    if (!in || generator > XORSHIFT_GENERATOR || loaded.random.bufferLeft > RandomState::BUFFER_SIZE)
+        return false;
+    // States the generators can never reach: the standard one would leave RND looping forever,
+    // xorshift would stay at 0 and hand out nothing but zeros
+    if (loaded.random.standard == 0 || loaded.random.standard >= MINSTD_MODULUS || loaded.random.xorshift == 0)
+        return false;
+
+    snapshot = loaded;
+    return true;
+}
@@ -0,0 +1,51 @@
+#ifndef SNAPSHOT_HEADER
+#define SNAPSHOT_HEADER
+
+#include <array>
+#include <istream>
+#include <memory>
+#include <ostream>
+
+#include "chip8.h"
+
+// The complete state of a Chip8 at one point in time.
+// Memory is held as pages shared between snapshots for as long as the program leaves them unchanged,
+// so taking one every frame usually copies nothing but the registers and display
+struct Snapshot {
+    typedef std::array<uint8_t, MEMORY_PAGE_SIZE> Page;
+
+    std::shared_ptr<Page const> pages[MEMORY_PAGES];
+    uint8_t  registers[16];
+    uint16_t index;
+    uint16_t pc;
+    uint16_t stack[16];
+    uint8_t  sp;
+    uint8_t  delayTimer;
+    uint8_t  soundTimer;
+    uint16_t opcode;
+    uint64_t displayMemory[VIDEO_HEIGHT];
+    uint8_t  keypad[16];
+    RandomState random;
+};
+
+// Takes and restores snapshots of one device
+class Snapshotter {
+public:
+    Snapshotter(Chip8& device);
+
+    // Captures the device, reusing the pages of the last snapshot taken or restored that weren't written since
+    Snapshot take();
+    // Puts the device back exactly as it was when the snapshot was taken
+    void restore(Snapshot const& snapshot);
+
+    // Compact binary form, for save states and reproducing a run elsewhere.
+    // load() returns false, leaving snapshot untouched, when the stream doesn't hold a valid snapshot
+    static void save(Snapshot const& snapshot, std::ostream& out);
+    static bool load(std::istream& in, Snapshot& snapshot);
+
+private:
+    Chip8& device;
+    std::shared_ptr<Snapshot::Page const> current[MEMORY_PAGES]; // pages the device's memory matched last time
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef TRIPLEBUFFER_HEADER
+#define TRIPLEBUFFER_HEADER
+
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest of a stream of values from one thread to another without either ever waiting.
+// The writer fills its back slot and publishes it, the reader takes the newest published slot.
+// The three slots swap places through one atomic: the writer always has a slot of its own to fill,
+// the reader keeps the one it took until it takes another, and the slot in the middle holds the newest value.
+// Values published while the reader wasn't looking are overwritten, only the latest one is ever read.
+// One writer thread and one reader thread
+template<class T>
+class TripleBuffer {
+public:
+    TripleBuffer() : back(0), middle(1), front(2) {}
+
+    // Writer: the slot to fill, it isn't seen by the reader until publish()
+    T& write(){
+        return slots[back];
+    }
+    // Writer: makes the slot just filled the newest value
+    void publish(){
+        uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & SLOT;
+    }
+
+    // Reader: moves to the newest value when one was published since the last call, true if it did
+    bool update(){
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & SLOT;
+        return true;
+    }
+    // Reader: the value update() moved to last
+    T const& read() const {
+        return slots[front];
+    }
+
+private:
+    static const uint8_t SLOT = 0x3; // the slot index in middle
+    static const uint8_t FRESH = 0x4; // set in middle when the writer published it and the reader hasn't taken it
+
+    T slots[3];
+    uint8_t back; // only touched by the writer
+    std::atomic<uint8_t> middle;
+    uint8_t front; // only touched by the reader
+};
+
+#endif
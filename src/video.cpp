@@ -0,0 +1,132 @@
+#include "video.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define VIDEO_HAS_AVX2 // compiled for any x86-64, selected at runtime
+#endif
+
+// Expands a single row of pixels at scale 1
+typedef void (*expandLineFn)(uint64_t bits, unsigned int width, uint32_t* out, Palette const& palette);
+
+static void expandLineScalar(uint64_t bits, unsigned int width, uint32_t* out, Palette const& palette){
+    for (unsigned int col = 0; col < width; ++col){
+        // walk the row from its most significant (leftmost) pixel
+        *out++ = (bits & (1ull << 63u)) ? palette.on : palette.off;
+        bits <<= 1u;
+    }
+}
+
+#if defined(__SSE2__)
+// Four pixels at a time: each nibble of the row picks a mask of four lanes
+static void expandLineSSE2(uint64_t bits, unsigned int width, uint32_t* out, Palette const& palette){
+    const __m128i off = _mm_set1_epi32(static_cast<int>(palette.off));
+    const __m128i diff = _mm_set1_epi32(static_cast<int>(palette.on ^ palette.off));
+    // The leftmost pixel of a nibble is its highest bit, and goes into the lowest lane
+    const __m128i laneBits = _mm_setr_epi32(8, 4, 2, 1);
+
+    unsigned int col = 0;
+    for (; col + 4 <= width; col += 4){
+        __m128i nibble = _mm_set1_epi32(static_cast<int>(bits >> 60u));
+        __m128i mask = _mm_cmpeq_epi32(_mm_and_si128(nibble, laneBits), laneBits);
+        // off where the pixel is clear, off ^ (on ^ off) = on where it is set
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + col), _mm_xor_si128(off, _mm_and_si128(mask, diff)));
+        bits <<= 4u;
+    }
+    expandLineScalar(bits, width - col, out + col, palette);
+}
+#endif
+
+#if defined(VIDEO_HAS_AVX2)
+// Eight pixels at a time: each byte of the row picks a mask of eight lanes
+__attribute__((target("avx2")))
+static void expandLineAVX2(uint64_t bits, unsigned int width, uint32_t* out, Palette const& palette){
+    const __m256i off = _mm256_set1_epi32(static_cast<int>(palette.off));
+    const __m256i diff = _mm256_set1_epi32(static_cast<int>(palette.on ^ palette.off));
+    const __m256i laneBits = _mm256_setr_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+
+    unsigned int col = 0;
+    for (; col + 8 <= width; col += 8){
+        __m256i byte = _mm256_set1_epi32(static_cast<int>(bits >> 56u));
+        __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(byte, laneBits), laneBits);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + col), _mm256_xor_si256(off, _mm256_and_si256(mask, diff)));
+        bits <<= 8u;
+    }
+    expandLineScalar(bits, width - col, out + col, palette);
+}
+#endif
+
+static expandLineFn pickExpandLine(){
+#if defined(VIDEO_HAS_AVX2)
+    __builtin_cpu_init(); // may run before libgcc's own static initialization
+    if (__builtin_cpu_supports("avx2"))
+        return expandLineAVX2;
+#endif
+#if defined(__SSE2__)
+    return expandLineSSE2;
+#else
+    return expandLineScalar;
+#endif
+}
+
+// Picked on first use, which also makes it safe to call from other static initializers
+static expandLineFn expandLine(){
+    static const expandLineFn picked = pickExpandLine();
+    return picked;
+}
+
+// Shared by both versions: expands each row once, then widens and repeats it for the scale
+static void expand(expandLineFn line, uint64_t const* rows, unsigned int rowCount, unsigned int width, uint32_t* out,
+                   Palette const& palette, unsigned int scale, unsigned int pitch){
+    if (scale == 0)
+        scale = 1;
+    if (pitch == 0)
+        pitch = width * scale;
+
+    for (unsigned int row = 0; row < rowCount; ++row){
+        uint32_t* first = out + row * scale * pitch;
+
+        if (scale == 1){
+            line(rows[row], width, first, palette);
+            continue;
+        }
+        // Expand into the end of the scaled line, then widen from left to right,
+        // which never overwrites a pixel that hasn't been read yet
+        uint32_t* narrow = first + width * (scale - 1);
+        line(rows[row], width, narrow, palette);
+        for (unsigned int col = 0; col < width; ++col){
+            uint32_t pixel = narrow[col];
+            for (unsigned int i = 0; i < scale; ++i)
+                first[col * scale + i] = pixel;
+        }
+        // Every following line of the block is a copy
+        for (unsigned int i = 1; i < scale; ++i)
+            std::memcpy(first + i * pitch, first, width * scale * sizeof(uint32_t));
+    }
+}
+
+void expandRows(uint64_t const* rows, unsigned int rowCount, unsigned int width, uint32_t* out,
+                Palette const& palette, unsigned int scale, unsigned int pitch){
+    expand(expandLine(), rows, rowCount, width, out, palette, scale, pitch);
+}
+
+void expandRowsScalar(uint64_t const* rows, unsigned int rowCount, unsigned int width, uint32_t* out,
+                      Palette const& palette, unsigned int scale, unsigned int pitch){
+    expand(expandLineScalar, rows, rowCount, width, out, palette, scale, pitch);
+}
+
+char const* expandRowsImplementation(){
+#if defined(VIDEO_HAS_AVX2)
+    if (expandLine() == expandLineAVX2)
+        return "avx2";
+#endif
+#if defined(__SSE2__)
+    if (expandLine() == expandLineSSE2)
+        return "sse2";
+#endif
+    return "scalar";
+}
@@ -0,0 +1,27 @@
+#ifndef VIDEO_HEADER
+#define VIDEO_HEADER
+
+#include <cstdint>
+
+// Colours of the two pixel states, in the SDL_PIXELFORMAT_RGBA8888 layout (0xRRGGBBAA)
+struct Palette {
+    uint32_t off;
+    uint32_t on;
+};
+const Palette DEFAULT_PALETTE = { 0x00000000, 0xFFFFFFFF };
+
+// Expands rows of the packed 1 bit per pixel display into 32 bit pixels for presenting.
+// rows points at the first packed row to expand, and out at where its first pixel goes,
+// width pixels are taken from the most significant end of each row word.
+// Every pixel becomes a scale x scale block, and pitch is the number of pixels per output row
+// (0 means width * scale).
+// Uses AVX2 or SSE2 when the host supports them.
+void expandRows(uint64_t const* rows, unsigned int rowCount, unsigned int width, uint32_t* out,
+                Palette const& palette = DEFAULT_PALETTE, unsigned int scale = 1, unsigned int pitch = 0);
+// Plain one pixel at a time version, the reference for the vectorized ones
+void expandRowsScalar(uint64_t const* rows, unsigned int rowCount, unsigned int width, uint32_t* out,
+                      Palette const& palette = DEFAULT_PALETTE, unsigned int scale = 1, unsigned int pitch = 0);
+// Name of the implementation expandRows picked for this host, "avx2", "sse2" or "scalar"
+char const* expandRowsImplementation();
+
+#endif
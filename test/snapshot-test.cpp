@@ -0,0 +1,51 @@
+#include "../src/chip8.h"
+#include "../src/snapshot.h"
+
+#include <iostream>
+#include <sstream>
+
+// Saves snapshots with random states the generator can't reach and checks the loader turns them down,
+// a state like that would hang or break RND on the machine it is restored into
+namespace {
+
+int failures = 0;
+
+void check(bool passed, char const* name){
+    std::cout << (passed ? "pass: " : "FAIL: ") << name << std::endl;
+    if (!passed)
+        ++failures;
+}
+
+// Writes snapshot out and reads it back, as a save state file would be
+bool roundTrip(Snapshot const& snapshot){
+    std::stringstream file;
+    Snapshotter::save(snapshot, file);
+    Snapshot loaded;
+    return Snapshotter::load(file, loaded);
+}
+
+Snapshot withStandardState(Snapshot snapshot, uint32_t state){
+    snapshot.random.standard = state;
+    return snapshot;
+}
+
+Snapshot withXorshiftState(Snapshot snapshot, uint64_t state){
+    snapshot.random.xorshift = state;
+    return snapshot;
+}
+}
+
+int main(){
+    Chip8 device;
+    Snapshotter snapshotter(device);
+    Snapshot snapshot = snapshotter.take();
+
+    check(roundTrip(snapshot), "a snapshot taken from a machine loads");
+    check(!roundTrip(withStandardState(snapshot, 0)), "a standard generator state of 0 is rejected");
+    check(!roundTrip(withStandardState(snapshot, MINSTD_MODULUS)), "a standard generator state of the modulus is rejected");
+    check(!roundTrip(withStandardState(snapshot, 0xFFFFFFFFu)), "a standard generator state past the modulus is rejected");
+    check(roundTrip(withStandardState(snapshot, MINSTD_MODULUS - 1)), "the largest standard generator state loads");
+    check(!roundTrip(withXorshiftState(snapshot, 0)), "a xorshift state of 0 is rejected");
+    check(roundTrip(withXorshiftState(snapshot, 1)), "any other xorshift state loads");
+    return failures == 0 ? 0 : 1;
+}